@@ -0,0 +1,114 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file acceleration_calibration.cpp
+/// @brief Class to calibrate the acceleration and top speed against an index sensor, and store them in EEPROM.
+
+#include "acceleration_calibration.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+namespace mtspin {
+
+AccelerationCalibration::AccelerationCalibration(uint16_t eeprom_address) : eeprom_address_(eeprom_address) {}
+
+AccelerationCalibration::~AccelerationCalibration() {}
+
+bool AccelerationCalibration::Load(float& acceleration, float& speed_RPM) const {
+  Record record;
+  EEPROM.get(eeprom_address_, record);
+  // Erased EEPROM reads as NaN floats, which fail the range checks.
+  if (record.version != kVersion_ || !(record.acceleration > 0.0F) || !(record.speed_RPM > 0.0F)) return false;
+  acceleration = record.acceleration;
+  speed_RPM = record.speed_RPM;
+  return true;
+}
+
+void AccelerationCalibration::Begin(float acceleration, float speed_RPM, float max_speed_RPM,
+                                    float microsteps_per_revolution, uint16_t tolerance_microsteps, float margin) {
+  base_acceleration_ = acceleration;
+  base_speed_RPM_ = speed_RPM;
+  max_speed_RPM_ = max_speed_RPM;
+  microsteps_per_revolution_ = microsteps_per_revolution;
+  tolerance_microsteps_ = tolerance_microsteps;
+  margin_ = margin;
+  scale_ = kFirstLevelScale_;
+  index_found_[0] = false;
+  index_found_[1] = false;
+  index_active_ = false;
+  index_passed_ = false;
+  step_lost_ = false;
+  level_ = 0;
+  ramp_ = 0;
+}
+
+void AccelerationCalibration::CheckIndex(bool index_active, int32_t position) {
+  bool triggered = index_active && !index_active_;
+  index_active_ = index_active;
+  if (!triggered) return;
+
+  // The sensor becomes active on opposite edges of the index in each direction, so each has its own reference.
+  index_passed_ = true;
+  uint8_t direction_index = ramp_ % 2;
+  float offset = fmod(static_cast<float>(position), microsteps_per_revolution_);
+  if (offset < 0.0F) offset += microsteps_per_revolution_;
+  if (!index_found_[direction_index]) {
+    index_offsets_[direction_index] = offset;
+    index_found_[direction_index] = true;
+    return;
+  }
+
+  float error = offset - index_offsets_[direction_index];
+  if (error > microsteps_per_revolution_ / 2.0F) error -= microsteps_per_revolution_;
+  else if (error < -microsteps_per_revolution_ / 2.0F) error += microsteps_per_revolution_;
+  if (fabs(error) > tolerance_microsteps_) step_lost_ = true;
+}
+
+AccelerationCalibration::Status AccelerationCalibration::EndRamp() {
+  // A ramp without an index pass stalled (or the sensor is missing).
+  if (!index_passed_) step_lost_ = true;
+  index_passed_ = false;
+  if (step_lost_) {
+    if (level_ == 0) return Status::kFailed;
+    Store(scale_ / kLevelScale_);
+    return Status::kDone;
+  }
+
+  if (++ramp_ < kRampsPerLevel_) return Status::kRunning;
+  ramp_ = 0;
+  if (level_ + 1 == kSizeOfLevels_) {
+    Store(scale_);
+    return Status::kDone;
+  }
+
+  level_++;
+  scale_ *= kLevelScale_;
+  return Status::kRunning;
+}
+
+float AccelerationCalibration::acceleration() const {
+  return base_acceleration_ * scale_;
+}
+
+float AccelerationCalibration::speed_RPM() const {
+  float speed_RPM = base_speed_RPM_ * scale_;
+  return (speed_RPM > max_speed_RPM_) ? max_speed_RPM_ : speed_RPM;
+}
+
+int8_t AccelerationCalibration::direction() const {
+  return (ramp_ % 2 == 0) ? 1 : -1;
+}
+
+void AccelerationCalibration::Store(float scale) const {
+  Record record;
+  record.version = kVersion_;
+  record.acceleration = base_acceleration_ * scale * margin_;
+  float speed_RPM = base_speed_RPM_ * scale;
+  record.speed_RPM = ((speed_RPM > max_speed_RPM_) ? max_speed_RPM_ : speed_RPM) * margin_;
+  EEPROM.put(eeprom_address_, record);
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file acceleration_calibration.h
+/// @brief Class to calibrate the acceleration and top speed against an index sensor, and store them in EEPROM.
+
+#ifndef ACCELERATION_CALIBRATION_H_
+#define ACCELERATION_CALIBRATION_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The Acceleration Calibration class.
+/// Calibration runs ramps (moves of a few revolutions, alternating in direction) in levels of increasing acceleration
+/// and top speed. The position at which the index sensor becomes active is recorded on the first pass in each
+/// direction; any later pass more than the tolerance away from it (or a ramp with no pass at all) means steps were
+/// lost. The acceleration and top speed of the last level without step loss, reduced by the margin, are stored.
+///
+/// EEPROM layout: a version byte (kVersion_; anything else means not calibrated), then the acceleration
+/// (microsteps per second-squared) and top speed (RPM), as floats.
+class AccelerationCalibration {
+ public:
+
+  /// @brief Enum of calibration statuses.
+  enum class Status {
+    kRunning = 0, ///< More ramps are to be run.
+    kDone, ///< Calibrated; the results are stored.
+    kFailed, ///< Steps were lost (or the index was not found) at the lowest level; nothing is stored.
+  };
+
+  static const uint16_t kSizeOfEeprom_ = 1 + (2 * 4); ///< EEPROM used by the calibration (bytes).
+  static constexpr float kRampAngle_degrees_ = 720.0F; ///< Angle of each ramp (degrees); passes the index at least once.
+
+  /// @brief Construct an Acceleration Calibration object.
+  /// @param eeprom_address The EEPROM address of the calibration.
+  explicit AccelerationCalibration(uint16_t eeprom_address);
+
+  /// @brief Destroy the Acceleration Calibration object.
+  ~AccelerationCalibration();
+
+  /// @brief Load the stored calibration.
+  /// @param acceleration The calibrated acceleration (microsteps per second-squared); unchanged if not calibrated.
+  /// @param speed_RPM The calibrated top speed (RPM); unchanged if not calibrated.
+  /// @return True if a calibration is stored.
+  bool Load(float& acceleration, float& speed_RPM) const;
+
+  /// @brief Start a calibration from the lowest level.
+  /// @param acceleration The acceleration (microsteps per second-squared) that the levels are scaled from.
+  /// @param speed_RPM The top speed (RPM) that the levels are scaled from.
+  /// @param max_speed_RPM The max speed (RPM) of any level.
+  /// @param microsteps_per_revolution The no. of microsteps per revolution of the system (between index passes).
+  /// @param tolerance_microsteps The max difference (microsteps) between index passes without step loss.
+  /// @param margin The fraction of the highest acceleration and top speed without step loss that is stored.
+  void Begin(float acceleration, float speed_RPM, float max_speed_RPM, float microsteps_per_revolution,
+             uint16_t tolerance_microsteps, float margin);
+
+  /// @brief Check the index sensor for a pass, and compare its position with the first pass.
+  /// @param index_active Whether the index sensor is active.
+  /// @param position The position (microsteps).
+  void CheckIndex(bool index_active, int32_t position); ///< This must be called repeatedly during each ramp.
+
+  /// @brief End a ramp, and move on to the next ramp or level, or finish the calibration.
+  /// @return The calibration status.
+  Status EndRamp();
+
+  /// @brief Get the acceleration of the current level.
+  /// @return The acceleration (microsteps per second-squared).
+  float acceleration() const;
+
+  /// @brief Get the top speed of the current level.
+  /// @return The top speed (RPM).
+  float speed_RPM() const;
+
+  /// @brief Get the direction of the next ramp.
+  /// @return The direction; 1 (positive) or -1 (negative).
+  int8_t direction() const;
+
+ private:
+
+  /// @brief The stored calibration.
+  struct Record {
+    uint8_t version; ///< Version of the stored layout.
+    float acceleration; ///< Acceleration (microsteps per second-squared).
+    float speed_RPM; ///< Top speed (RPM).
+  };
+
+  static const uint8_t kVersion_ = 1; ///< Version of the stored layout.
+  static const uint8_t kSizeOfLevels_ = 8; ///< No. of levels.
+  static const uint8_t kRampsPerLevel_ = 4; ///< No. of ramps per level; even, so each level ends where it started.
+  static constexpr float kFirstLevelScale_ = 0.5F; ///< Scale of the first level, relative to the given values.
+  static constexpr float kLevelScale_ = 1.25F; ///< Scale of each level, relative to the last.
+
+  /// @brief Store a level, reduced by the margin.
+  /// @param scale The scale of the level.
+  void Store(float scale) const;
+
+  uint16_t eeprom_address_; ///< The EEPROM address of the calibration.
+  float base_acceleration_ = 0.0F; ///< Acceleration (microsteps per second-squared) that the levels are scaled from.
+  float base_speed_RPM_ = 0.0F; ///< Top speed (RPM) that the levels are scaled from.
+  float max_speed_RPM_ = 0.0F; ///< Max speed (RPM) of any level.
+  float microsteps_per_revolution_ = 0.0F; ///< No. of microsteps per revolution of the system.
+  float tolerance_microsteps_ = 0.0F; ///< Max difference (microsteps) between index passes without step loss.
+  float margin_ = 1.0F; ///< Fraction of the calibrated values that is stored.
+  float scale_ = 0.0F; ///< Scale of the current level.
+  float index_offsets_[2] = {0.0F, 0.0F}; ///< Position (microsteps, within a revolution) of the first index pass in each direction.
+  bool index_found_[2] = {false, false}; ///< Whether the index has been passed in each direction.
+  bool index_active_ = false; ///< Whether the index sensor was active at the last check.
+  bool index_passed_ = false; ///< Whether the index was passed during the current ramp.
+  bool step_lost_ = false; ///< Whether steps were lost at the current level.
+  uint8_t level_ = 0; ///< The current level.
+  uint8_t ramp_ = 0; ///< The current ramp within the level.
+};
+
+} // namespace mtspin
+
+#endif // ACCELERATION_CALIBRATION_H_
\ No newline at end of file
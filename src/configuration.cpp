@@ -10,8 +10,208 @@
 
 #include <ArduinoLog.h>
 
+#include "acceleration_calibration.h"
+#include "configuration_blob.h"
+#include "profile_slots.h"
+
 namespace mtspin {
 
+namespace {
+
+/// @brief Get the no. of microsteps per revolution of the system (i.e., after the gear ratio).
+/// @return The no. of microsteps per revolution.
+constexpr float MicrostepsPerRevolution() {
+  return (360.0F / Configuration::kFullStepAngle_degrees_) * Configuration::kMicrostepMode_
+         * Configuration::kGearRatioNumerator_ / Configuration::kGearRatioDenominator_;
+}
+
+/// @brief Check that there is a whole no. of full steps per revolution of the motor.
+/// @return True if the no. of full steps per revolution is a whole number.
+constexpr bool WholeFullStepsPerRevolution() {
+  return (360.0F / Configuration::kFullStepAngle_degrees_)
+         - static_cast<uint16_t>((360.0F / Configuration::kFullStepAngle_degrees_) + 0.5F) < 0.001F
+         && (360.0F / Configuration::kFullStepAngle_degrees_)
+            - static_cast<uint16_t>((360.0F / Configuration::kFullStepAngle_degrees_) + 0.5F) > -0.001F;
+}
+
+/// @brief Get the step rate for a speed.
+/// @param speed_RPM The speed (RPM).
+/// @return The step rate (microsteps per second).
+constexpr float StepRate(float speed_RPM) {
+  return speed_RPM * MicrostepsPerRevolution() / 60.0F;
+}
+
+/// @brief Get the no. of microsteps for a sweep angle.
+/// @param angle_degrees The sweep angle (degrees).
+/// @return The no. of microsteps.
+constexpr float SweepMicrosteps(float angle_degrees) {
+  return angle_degrees * MicrostepsPerRevolution() / 360.0F;
+}
+
+/// @brief Get the smallest acceleration curve scale factor, from an index onwards.
+/// @param curve_index The index of the first curve point to check.
+/// @return The smallest scale factor.
+constexpr float MinAccelerationScale(uint8_t curve_index) {
+  return (curve_index >= Configuration::kSizeOfAccelerationCurve_ - 1)
+         ? Configuration::kAccelerationCurveScales_[curve_index]
+         : ((Configuration::kAccelerationCurveScales_[curve_index] < MinAccelerationScale(curve_index + 1))
+            ? Configuration::kAccelerationCurveScales_[curve_index]
+            : MinAccelerationScale(curve_index + 1));
+}
+
+/// @brief Check that the acceleration curve speeds are ascending and the scale factors are positive, from an index onwards.
+/// @param curve_index The index of the first curve point to check.
+/// @return True if the acceleration curve is valid.
+constexpr bool AccelerationCurveValid(uint8_t curve_index) {
+  return curve_index >= Configuration::kSizeOfAccelerationCurve_
+         || (Configuration::kAccelerationCurveScales_[curve_index] > 0.0F
+             && (curve_index == 0 || Configuration::kAccelerationCurveSpeeds_RPM_[curve_index]
+                                     > Configuration::kAccelerationCurveSpeeds_RPM_[curve_index - 1])
+             && AccelerationCurveValid(curve_index + 1));
+}
+
+/// @brief Get the no. of microsteps to accelerate from standstill to a speed and decelerate back to standstill.
+/// The lowest acceleration on the acceleration curve is assumed throughout.
+/// @param speed_RPM The speed (RPM).
+/// @return The no. of microsteps.
+constexpr float RampMicrosteps(float speed_RPM) {
+  return (StepRate(speed_RPM) * StepRate(speed_RPM) / 2.0F)
+         * ((1.0F / (Configuration::kAcceleration_microsteps_per_s_per_s_ * MinAccelerationScale(0)))
+            + (1.0F / Configuration::kDeceleration_microsteps_per_s_per_s_));
+}
+
+/// @brief Check that the speeds, from an index onwards, are below the max step rate at the max speed override.
+/// @param speeds_RPM The lookup table of speeds (RPM).
+/// @param speed_index The index of the first speed to check.
+/// @return True if all the speeds are below the max step rate.
+constexpr bool SpeedsBelowMaxStepRate(const float* speeds_RPM, uint8_t speed_index) {
+  return speed_index >= Configuration::kSizeOfSpeeds_
+         || (StepRate(speeds_RPM[speed_index] * Configuration::kMaxSpeedOverride_percent_ / 100.0F)
+                < Configuration::kMaxStepRate_microsteps_per_s_
+             && SpeedsBelowMaxStepRate(speeds_RPM, speed_index + 1));
+}
+
+/// @brief Check that the ramp for a speed fits within the sweep angles, from an index onwards.
+/// @param speed_RPM The speed (RPM).
+/// @param sweep_angle_index The index of the first sweep angle to check.
+/// @return True if the ramp fits within all the sweep angles.
+constexpr bool RampFitsSweepAngles(float speed_RPM, uint8_t sweep_angle_index) {
+  return sweep_angle_index >= Configuration::kSizeOfSweepAngles_
+         || (RampMicrosteps(speed_RPM) <= SweepMicrosteps(Configuration::kSweepAngles_degrees_[sweep_angle_index])
+             && RampFitsSweepAngles(speed_RPM, sweep_angle_index + 1));
+}
+
+/// @brief Check that the ramps for the speeds, from an index onwards, fit within all the sweep angles.
+/// @param speeds_RPM The lookup table of speeds (RPM).
+/// @param speed_index The index of the first speed to check.
+/// @return True if all the ramps fit within all the sweep angles.
+constexpr bool RampsFitSweepAngles(const float* speeds_RPM, uint8_t speed_index) {
+  return speed_index >= Configuration::kSizeOfSpeeds_
+         || (RampFitsSweepAngles(speeds_RPM[speed_index], 0)
+             && RampsFitSweepAngles(speeds_RPM, speed_index + 1));
+}
+
+/// @brief Check that the step interval dithers, from an index onwards, are within 1/8 of the step interval.
+/// @param speed_index The index of the first speed to check.
+/// @return True if all the dithers are within the limit.
+constexpr bool SpeedDithersValid(uint8_t speed_index) {
+  return speed_index >= Configuration::kSizeOfSpeeds_
+         || (Configuration::kSpeedDithers_[speed_index] <= 128 && SpeedDithersValid(speed_index + 1));
+}
+
+/// @brief Get the sum of the anti-cogging corrections, from an index onwards.
+/// @param correction_index The index of the first correction to add.
+/// @return The sum of the corrections.
+constexpr int16_t CoggingCorrectionsSum(uint8_t correction_index) {
+  return (correction_index >= Configuration::kSizeOfCoggingCorrections_)
+         ? 0
+         : Configuration::kCoggingCorrections_[correction_index] + CoggingCorrectionsSum(correction_index + 1);
+}
+
+// Impossible configurations fail the build.
+static_assert(SpeedsBelowMaxStepRate(Configuration::kSpeeds_RPM_, 0)
+              && SpeedsBelowMaxStepRate(Configuration::kReturnSpeeds_RPM_, 0),
+              "A speed (kSpeeds_RPM_/kReturnSpeeds_RPM_), at the max speed override, exceeds the max step rate (kMaxStepRate_microsteps_per_s_).");
+static_assert(Configuration::kMinSpeedOverride_percent_ > 0
+              && Configuration::kMinSpeedOverride_percent_ <= 100
+              && Configuration::kMaxSpeedOverride_percent_ >= 100,
+              "The speed override range must include 100% and exclude 0%.");
+static_assert(AccelerationCurveValid(0),
+              "The acceleration curve speeds must be ascending and its scale factors must be positive.");
+static_assert(Configuration::kDeceleration_microsteps_per_s_per_s_ > 0.0F
+              && Configuration::kQuickStopDeceleration_microsteps_per_s_per_s_
+                 >= Configuration::kDeceleration_microsteps_per_s_per_s_,
+              "The quick stop deceleration must be at least the (non-zero) deceleration.");
+static_assert(RampsFitSweepAngles(Configuration::kSpeeds_RPM_, 0)
+              && RampsFitSweepAngles(Configuration::kReturnSpeeds_RPM_, 0),
+              "A speed (kSpeeds_RPM_/kReturnSpeeds_RPM_) cannot be reached and stopped within a sweep angle (kSweepAngles_degrees_).");
+static_assert(SpeedDithersValid(0),
+              "The step interval dithers (kSpeedDithers_) must be at most 128 parts per 1024.");
+static_assert(WholeFullStepsPerRevolution() && Configuration::kGearRatioNumerator_ > 0
+              && Configuration::kGearRatioDenominator_ > 0,
+              "There must be a whole no. of full steps (kFullStepAngle_degrees_) per revolution, and a non-zero gear ratio.");
+static_assert(Configuration::kSizeOfCoggingCorrections_ > 0
+              && (4U * Configuration::kMicrostepMode_) % Configuration::kSizeOfCoggingCorrections_ == 0,
+              "The anti-cogging table size must divide the no. of microsteps per electrical cycle (4 full steps).");
+static_assert(CoggingCorrectionsSum(0) == 0,
+              "The anti-cogging corrections (kCoggingCorrections_) must be zero-mean, so the average speed is unchanged.");
+static_assert(Configuration::kCalibrationEepromAddress_ + AccelerationCalibration::kSizeOfEeprom_
+              <= Configuration::kBlobEepromAddress_,
+              "The acceleration calibration overlaps the configuration banks (kBlobEepromAddress_).");
+static_assert(Configuration::kBlobEepromAddress_ + ConfigurationBlob::kSizeOfEeprom_ <= E2END + 1,
+              "The EEPROM layout (acceleration calibration, and two banks of keyframe track, schedule and profiles) does not fit in the EEPROM.");
+static_assert(Configuration::kSizeOfSpeeds_ == ProfileSlots::kSizeOfTables_
+              && Configuration::kSizeOfSweepAngles_ == ProfileSlots::kSizeOfTables_,
+              "The speed and sweep angle lookup tables must be the size of the profile tables (ProfileSlots::kSizeOfTables_).");
+#if !defined(MTSPIN_INPUT_SHAPING)
+static_assert(Configuration::kInputShaperType_ == Configuration::InputShaperType::kNone,
+              "Input shaping (kInputShaperType_) requires MTSPIN_INPUT_SHAPING to be defined.");
+#endif
+#if defined(MTSPIN_SPI_STEPPING)
+static_assert(Configuration::kPulPin_ == PIN_SPI_MOSI,
+              "SPI stepping requires the PUL pin (kPulPin_) to be the SPI MOSI pin.");
+static_assert(Configuration::kDirPin_ != PIN_SPI_MISO && Configuration::kDirPin_ != PIN_SPI_SCK
+              && Configuration::kEnaPin_ != PIN_SPI_MISO && Configuration::kEnaPin_ != PIN_SPI_SCK,
+              "SPI stepping takes over the SPI MISO and SCK pins; move the DIR (kDirPin_) and ENA (kEnaPin_) pins.");
+static_assert(!Configuration::kDoubleEdgeStepping_,
+              "SPI stepping outputs pulses, so it cannot be used with double-edge stepping (kDoubleEdgeStepping_).");
+#endif
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+static_assert(F_CPU / 8 / Configuration::kStepTickRate_Hz_ <= 256
+              && (F_CPU / 8 / Configuration::kStepTickRate_Hz_) >> Configuration::kMaxStepSmoothingLevel_ >= 2,
+              "The step tick rate (kStepTickRate_Hz_), at each smoothing level, is out of range for Timer2 with a prescaler of 8.");
+static_assert(Configuration::kMaxStepRate_microsteps_per_s_
+              <= (Configuration::kDoubleEdgeStepping_ ? Configuration::kStepTickRate_Hz_ : Configuration::kStepTickRate_Hz_ / 2.0F),
+              "The max step rate (kMaxStepRate_microsteps_per_s_) exceeds the step generator's max (half the tick rate, or the tick rate with double-edge stepping).");
+#endif
+
+} // namespace
+
+// Definitions of static constexpr members (required when odr-used before C++17).
+constexpr float Configuration::kFullStepAngle_degrees_;
+constexpr uint16_t Configuration::kGearRatioNumerator_;
+constexpr uint16_t Configuration::kGearRatioDenominator_;
+constexpr uint8_t Configuration::kPulPin_;
+constexpr uint8_t Configuration::kDirPin_;
+constexpr uint8_t Configuration::kEnaPin_;
+constexpr uint16_t Configuration::kMicrostepMode_;
+constexpr float Configuration::kSweepAngles_degrees_[];
+constexpr float Configuration::kSpeeds_RPM_[];
+constexpr float Configuration::kReturnSpeeds_RPM_[];
+constexpr uint8_t Configuration::kSpeedDithers_[];
+constexpr float Configuration::kMaxStepRate_microsteps_per_s_;
+constexpr bool Configuration::kDoubleEdgeStepping_;
+constexpr uint8_t Configuration::kMinSpeedOverride_percent_;
+constexpr uint8_t Configuration::kMaxSpeedOverride_percent_;
+constexpr float Configuration::kAcceleration_microsteps_per_s_per_s_;
+constexpr float Configuration::kAccelerationCurveSpeeds_RPM_[];
+constexpr float Configuration::kAccelerationCurveScales_[];
+constexpr float Configuration::kDeceleration_microsteps_per_s_per_s_;
+constexpr float Configuration::kQuickStopDeceleration_microsteps_per_s_per_s_;
+constexpr int8_t Configuration::kCoggingCorrections_[];
+constexpr uint32_t Configuration::kStepTickRate_Hz_;
+constexpr uint8_t Configuration::kMaxStepSmoothingLevel_;
+
 Configuration& Configuration::GetInstance() {
   static Configuration instance;
   return instance;
@@ -28,6 +228,7 @@ void Configuration::BeginHardware() const {
   pinMode(kDirectionButtonPin_, INPUT);
   pinMode(kAngleButtonPin_, INPUT);
   pinMode(kSpeedButtonPin_, INPUT);
+  pinMode(kIndexSensorPin_, INPUT);
 
   // Initialise the output pins.
   pinMode(kPulPin_, OUTPUT);
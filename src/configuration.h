@@ -21,6 +21,27 @@
 #define MTSPIN_SERIAL Serial // "Serial" for programming port, "SerialUSB" for native port (Due and Zero only).
 #endif
 
+/// @brief Macro to enable cycle-accurate profiling of the control loop (AVR only; uses Timer1).
+//#define MTSPIN_PROFILING
+
+/// @brief Macro to take steps from a fixed-rate timer interrupt rather than by polling (AVR only; uses Timer2).
+//#define MTSPIN_FIXED_RATE_STEPPING
+
+/// @brief Macro to shift out step pulses by SPI when jogging at constant high speed (experimental; AVR only; PUL must
+/// be on MOSI, and DIR/ENA must be moved off MISO/SCK).
+//#define MTSPIN_SPI_STEPPING
+
+/// @brief Macro to follow an external step/direction input in gearing mode (AVR only; uses Timer1, so it cannot be
+/// combined with MTSPIN_PROFILING).
+//#define MTSPIN_ELECTRONIC_GEARING
+
+/// @brief Macro to shape the commanded velocity to suppress a resonance of the load (see kInputShaperType_; adds a
+/// velocity history buffer).
+//#define MTSPIN_INPUT_SHAPING
+
+/// @brief Macro to enable PVT mode, following a trajectory streamed by a host (adds a trajectory point buffer).
+//#define MTSPIN_PVT_STREAMING
+
 namespace mtspin {
 
 /// @brief The Configuration class using the singleton pattern i.e., only a single instance can exist.
@@ -31,6 +52,10 @@ class Configuration {
   enum class ControlMode {
     kContinuous = 1,
     kOscillate,
+    kPvt, ///< Follow a streamed position-velocity-time (PVT) trajectory.
+    kTrack, ///< Play back the stored keyframe track.
+    kGearing, ///< Follow an external step/direction input (electronic gearing).
+    kCalibrate, ///< Calibrate the acceleration and top speed against the index sensor.
   };
 
   /// @brief Enum of control actions.
@@ -42,9 +67,26 @@ class Configuration {
     kToggleLogReport = 'r',
     kLogGeneralStatus = 'l',
     kReportFirmwareVersion = 'v',
+    kReportProfile = 'b',
+    kQuickStop = 'x',
+    kIncreaseSpeedOverride = '+',
+    kDecreaseSpeedOverride = '-',
+    kResetSpeedOverride = '=',
+    kStreamTrajectory = 'p',
+    kPlayTrack = 't',
+    kFollowGearInput = 'g',
+    kCalibrateAcceleration = 'c',
+    kCycleProfile = 'n',
     kIdle = '0',
   };
 
+  /// @brief Enum of input shaper types.
+  enum class InputShaperType {
+    kNone = 0, ///< No shaping.
+    kZeroVibration, ///< ZV; two impulses over half a damped period.
+    kZeroVibrationDerivative, ///< ZVD; three impulses over one damped period (more robust to frequency errors).
+  };
+
   /// @brief Static method to get the single instance.
   /// @return The Configuration instance. 
   static Configuration& GetInstance();
@@ -68,9 +110,12 @@ class Configuration {
   const uint8_t kDirectionButtonPin_ = 2; ///< Input pin for the button controlling motor direction.
   const uint8_t kAngleButtonPin_ = 3; ///< Input pin for the button controlling motor angle.
   const uint8_t kSpeedButtonPin_ = 4; ///< Input pin for the button controlling motor speed.
-  const uint8_t kPulPin_ = 11; ///< Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
-  const uint8_t kDirPin_ = 12; ///< Output pin for the stepper driver DIR/CW (direction) interface.
-  const uint8_t kEnaPin_ = 13; ///< Output pin for the stepper driver ENA/EN (enable) interface.
+  static constexpr uint8_t kPulPin_ = 11; ///< Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
+  static constexpr uint8_t kDirPin_ = 12; ///< Output pin for the stepper driver DIR/CW (direction) interface.
+  static constexpr uint8_t kEnaPin_ = 13; ///< Output pin for the stepper driver ENA/EN (enable) interface.
+  const uint8_t kSpeedOverridePin_ = A0; ///< Analog input pin for the speed override (potentiometer), if enabled.
+  const uint8_t kIndexSensorPin_ = 7; ///< Input pin for the index sensor (active once per revolution of the system), if fitted.
+  static constexpr uint8_t kGearInputDirPin_ = 6; ///< Input pin for the master direction signal (MTSPIN_ELECTRONIC_GEARING); master step pulses go to the Timer1 clock input (T1; pin 5 on the Uno).
 
   // Control system properties.
   const ControlMode kDefaultControlMode_ = ControlMode::kContinuous; ///< The default/initial control mode. 
@@ -86,23 +131,59 @@ class Configuration {
   const mt::MomentaryButton::LongPressOption kLongPressOption_ = mt::MomentaryButton::LongPressOption::kDetectWhileHolding; ///< Button long press options.
 
   // Stepper motor/drive system properties.
-  const float kFullStepAngle_degrees_ = 1.8F; ///< The stepper motor full step angle (degrees).
-  const float kGearRatio_ = 1.0F; ///< The system/stepper motor gear ratio.
+  static constexpr float kFullStepAngle_degrees_ = 1.8F; ///< The stepper motor full step angle (degrees).
+  static constexpr uint16_t kGearRatioNumerator_ = 1; ///< The system/stepper motor gear ratio numerator (e.g., 60 for 60:17).
+  static constexpr uint16_t kGearRatioDenominator_ = 1; ///< The system/stepper motor gear ratio denominator (e.g., 17 for 60:17).
 
   // Stepper driver properties.
-  const uint16_t kMicrostepMode_ = 32; ///< Stepper driver microstep mode.
+  static constexpr uint16_t kMicrostepMode_ = 32; ///< Stepper driver microstep mode.
   const float kPulDelay_us_ = 1.0; ///< Minimum delay (us) for the stepper driver PUL pin.
+  static constexpr bool kDoubleEdgeStepping_ = false; ///< Whether the stepper driver steps on both PUL edges (e.g., TMC dedge); PUL is toggled once per step, with no pulse delay.
   const float kDirDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Dir pin.
   const float kEnaDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Ena pin.
+  const uint8_t kPositiveDirPinState_ = HIGH; ///< Stepper driver DIR pin state for motion in the positive direction.
   const mt::StepperDriver::MotionDirection kDefaultMotionDirection_ = mt::StepperDriver::MotionDirection::kPositive; ///< Initial/default motion direction (Clockwise (CW)).
   static const uint8_t kSizeOfSweepAngles_ = 4; ///< No. of sweep angles in the lookup table.
-  const float kSweepAngles_degrees_[kSizeOfSweepAngles_] = {45.0F, 90.0F, 180.0F, 360.0F}; ///< Lookup table for sweep angles (degrees) during oscillation.
+  static constexpr float kSweepAngles_degrees_[kSizeOfSweepAngles_] = {45.0F, 90.0F, 180.0F, 360.0F}; ///< Lookup table for sweep angles (degrees) during oscillation.
   const uint8_t kDefaultSweepAngleIndex_ = 0; ///< Index of initial/default sweep angle.
   static const uint8_t kSizeOfSpeeds_ = 4; ///< No. of speeds in the lookup table.
-  const float kSpeeds_RPM_[kSizeOfSpeeds_] = {7.0F, 10.0F, 13.0F, 16.0F}; ///< Lookup table for rotation speeds (RPM).
+  static constexpr float kSpeeds_RPM_[kSizeOfSpeeds_] = {7.0F, 10.0F, 13.0F, 16.0F}; ///< Lookup table for rotation speeds (RPM).
+  static constexpr float kReturnSpeeds_RPM_[kSizeOfSpeeds_] = {7.0F, 10.0F, 13.0F, 16.0F}; ///< Lookup table for rotation speeds (RPM) of the negative (CCW) sweeps during oscillation, e.g., for a slow presentation sweep and a fast return.
   const uint8_t kDefaultSpeedIndex_ = 0; ///< Index of initial/default speed.
-  const float kAcceleration_microsteps_per_s_per_s_ = 6000.0; //8000.0; ///< Acceleration (microsteps per second-squared).
-  const mt::StepperDriver::AccelerationAlgorithm kAccelerationAlgorithm_ = mt::StepperDriver::AccelerationAlgorithm::kMorgridge24; ///< Acceleration algorithm.
+  static constexpr uint8_t kSpeedDithers_[kSizeOfSpeeds_] = {0, 0, 0, 0}; ///< Zero-mean pseudo-random step interval dither (parts per 1024, up to 128) for each speed, to spread the motor tone (0 to disable).
+  const uint16_t kSelfTestIterations_ = 200; ///< No. of control loop iterations timed at startup to measure the max step rate.
+  const float kStepRateMargin_ = 0.8F; ///< Fraction of the measured max step rate that the speeds are limited to.
+  static constexpr uint8_t kMinSpeedOverride_percent_ = 10; ///< Min speed override (% of the selected speed).
+  static constexpr uint8_t kMaxSpeedOverride_percent_ = 200; ///< Max speed override (% of the selected speed).
+  const uint8_t kSpeedOverrideStep_percent_ = 10; ///< Change in speed override for each increase/decrease command (%).
+  const bool kAnalogSpeedOverride_ = false; ///< Whether the speed override is set by the analog input (kSpeedOverridePin_) instead of serial commands.
+  const uint16_t kSpeedOverrideSamplePeriod_ms_ = 50; ///< Sample period (ms) of the analog speed override input.
+  static constexpr float kMaxStepRate_microsteps_per_s_ = 5000.0F; ///< Max step rate (microsteps per second) of any speed; checked at compile time.
+  static constexpr float kAcceleration_microsteps_per_s_per_s_ = 6000.0; //8000.0; ///< Acceleration (microsteps per second-squared).
+  static const uint8_t kSizeOfAccelerationCurve_ = 4; ///< No. of points in the acceleration (torque) curve.
+  static constexpr float kAccelerationCurveSpeeds_RPM_[kSizeOfAccelerationCurve_] = {0.0F, 5.0F, 10.0F, 16.0F}; ///< Speeds (RPM, ascending) of the acceleration curve points.
+  static constexpr float kAccelerationCurveScales_[kSizeOfAccelerationCurve_] = {1.5F, 1.3F, 1.1F, 1.0F}; ///< Acceleration scale factors at the curve speeds (linearly interpolated); follow the motor torque curve.
+  static constexpr float kDeceleration_microsteps_per_s_per_s_ = 9000.0F; ///< Deceleration when slowing down, reversing and stopping (microsteps per second-squared).
+  static constexpr float kQuickStopDeceleration_microsteps_per_s_per_s_ = 20000.0F; ///< Deceleration for quick stops (microsteps per second-squared).
+  const uint16_t kControlPeriod_us_ = 1000; ///< Period (us) of motion plan (velocity) updates.
+  static constexpr uint32_t kStepTickRate_Hz_ = 20000; ///< Tick rate (Hz) of the fixed-rate step generator (MTSPIN_FIXED_RATE_STEPPING); steps are at most half this rate.
+  const float kSpiSteppingMinStepRate_microsteps_per_s_ = 2000.0F; ///< Min step rate for SPI stepping (MTSPIN_SPI_STEPPING), when jogging at constant speed.
+  static constexpr uint8_t kMaxStepSmoothingLevel_ = 1; ///< Max step smoothing level of the fixed-rate step generator; the tick rate is doubled per level at low step rates (0 to disable).
+  static const uint8_t kSizeOfCoggingCorrections_ = 16; ///< No. of entries in the anti-cogging table, which covers one electrical cycle (4 full steps).
+  static constexpr int8_t kCoggingCorrections_[kSizeOfCoggingCorrections_] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; ///< Anti-cogging step interval corrections (parts per 1024, zero-mean), from the driver home position; fitted from measured speed ripple.
+  static constexpr InputShaperType kInputShaperType_ = InputShaperType::kNone; ///< Input shaper type; ZV or ZVD to suppress a resonance (e.g., display wobble on reversals); requires MTSPIN_INPUT_SHAPING.
+  const float kInputShaperFrequency_Hz_ = 3.0F; ///< Resonance frequency (Hz) of the load; measured, e.g., from a video of the wobble.
+  const float kInputShaperDampingRatio_ = 0.05F; ///< Resonance damping ratio of the load (0 to less than 1).
+  const uint8_t kGearInputPositiveDirPinState_ = HIGH; ///< Master direction pin state for motion in the positive direction.
+  const uint16_t kElectronicGearNumerator_ = 1; ///< Electronic gear ratio (microsteps per master step pulse) numerator.
+  const uint16_t kElectronicGearDenominator_ = 1; ///< Electronic gear ratio (microsteps per master step pulse) denominator; not 0.
+  const bool kIndexSensor_ = false; ///< Whether an index sensor is fitted (on kIndexSensorPin_), so the acceleration can be calibrated.
+  const uint8_t kIndexSensorActiveState_ = LOW; ///< Index sensor pin state at the index.
+  const float kCalibrationMargin_ = 0.8F; ///< Fraction of the highest acceleration and top speed without step loss that is stored by calibration.
+
+  // EEPROM layout (byte addresses).
+  static constexpr uint16_t kCalibrationEepromAddress_ = 0; ///< EEPROM address of the acceleration calibration (AccelerationCalibration::kSizeOfEeprom_ bytes); measured on each unit, so not part of the configuration blob.
+  static constexpr uint16_t kBlobEepromAddress_ = 9; ///< EEPROM address of the configuration banks (ConfigurationBlob::kSizeOfEeprom_ bytes), after the acceleration calibration, holding the keyframe track, schedule and profile slots.
 
   // Other properties.
   const uint16_t kStartupTime_ms_ = 1000; ///< Minimum startup/boot time in milliseconds (ms); based on the stepper driver.
@@ -0,0 +1,123 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file configuration_blob.cpp
+/// @brief Class to upload and export the stored configuration (track, schedule and profiles) as a single blob.
+
+#include "configuration_blob.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "frame_link.h"
+#include "keyframe_track.h"
+#include "profile_slots.h"
+#include "schedule.h"
+
+namespace mtspin {
+
+ConfigurationBlob::ConfigurationBlob(uint16_t eeprom_address) : eeprom_address_(eeprom_address) {}
+
+ConfigurationBlob::~ConfigurationBlob() {}
+
+void ConfigurationBlob::Begin() {
+  bank_ = (EEPROM.read(eeprom_address_) == 1) ? 1 : 0;
+}
+
+bool ConfigurationBlob::StoreChunk(const uint8_t* payload, uint8_t size) {
+  if (size < 3 || size > 2 + kMaxSizeOfChunk_) return false;
+  uint16_t offset = FrameLink::ReadUint16(payload);
+  if (offset + (size - 2) > kSizeOfBank_) return false;
+
+  pending_ = false;
+  uint16_t address = BankAddress(1 - bank_) + offset;
+  for (uint8_t i = 2; i < size; i++) {
+    EEPROM.update(address++, payload[i]);
+  }
+
+  return true;
+}
+
+bool ConfigurationBlob::Commit(const uint8_t* payload, uint8_t size) {
+  pending_ = false;
+  if (size != 5 || payload[0] != kVersion_ || FrameLink::ReadUint16(&payload[1]) != kSizeOfBank_) return false;
+  uint8_t bank = 1 - bank_;
+  if (FrameLink::ReadUint16(&payload[3]) != Crc(bank)) return false;
+
+  // Validate everything before any of it is put in use.
+  uint16_t address = BankAddress(bank);
+  pending_ = KeyframeTrack::Valid(address + kTrackOffset_) && Schedule::Valid(address + kScheduleOffset_)
+             && ProfileSlots::Valid(address + kProfileOffset_);
+  return pending_;
+}
+
+void ConfigurationBlob::Apply() {
+  if (!pending_) return;
+  bank_ = 1 - bank_;
+  EEPROM.update(eeprom_address_, bank_);
+  pending_ = false;
+}
+
+bool ConfigurationBlob::Export(const uint8_t* payload, uint8_t size) const {
+  uint8_t frame_payload[2 + kMaxSizeOfChunk_];
+  if (size == 0) {
+    frame_payload[0] = kVersion_;
+    FrameLink::WriteUint16(kSizeOfBank_, &frame_payload[1]);
+    FrameLink::WriteUint16(Crc(bank_), &frame_payload[3]);
+    FrameLink::Send(FrameLink::FrameType::kConfiguration, frame_payload, 5);
+    return true;
+  }
+
+  if (size != 2) return false;
+  uint16_t offset = FrameLink::ReadUint16(payload);
+  if (offset >= kSizeOfBank_) return false;
+
+  // The last chunk may be short.
+  uint8_t chunk_size = kMaxSizeOfChunk_;
+  if (kSizeOfBank_ - offset < chunk_size) chunk_size = kSizeOfBank_ - offset;
+  FrameLink::WriteUint16(offset, frame_payload);
+  uint16_t address = BankAddress(bank_) + offset;
+  for (uint8_t i = 0; i < chunk_size; i++) {
+    frame_payload[2 + i] = EEPROM.read(address + i);
+  }
+
+  FrameLink::Send(FrameLink::FrameType::kConfigurationChunk, frame_payload, 2 + chunk_size);
+  return true;
+}
+
+bool ConfigurationBlob::pending() const {
+  return pending_;
+}
+
+uint16_t ConfigurationBlob::track_address() const {
+  return BankAddress(bank_) + kTrackOffset_;
+}
+
+uint16_t ConfigurationBlob::schedule_address() const {
+  return BankAddress(bank_) + kScheduleOffset_;
+}
+
+uint16_t ConfigurationBlob::profile_address() const {
+  return BankAddress(bank_) + kProfileOffset_;
+}
+
+uint16_t ConfigurationBlob::BankAddress(uint8_t bank) const {
+  return eeprom_address_ + 1 + (bank * kSizeOfBank_);
+}
+
+uint16_t ConfigurationBlob::Crc(uint8_t bank) const {
+  uint16_t crc = 0xFFFF;
+  uint16_t address = BankAddress(bank);
+  for (uint16_t i = 0; i < kSizeOfBank_; i++) {
+    crc ^= static_cast<uint16_t>(EEPROM.read(address + i)) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+} // namespace mtspin
\ No newline at end of file
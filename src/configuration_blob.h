@@ -0,0 +1,109 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file configuration_blob.h
+/// @brief Class to upload and export the stored configuration (track, schedule and profiles) as a single blob.
+
+#ifndef CONFIGURATION_BLOB_H_
+#define CONFIGURATION_BLOB_H_
+
+#include <Arduino.h>
+
+#include "keyframe_track.h"
+#include "profile_slots.h"
+#include "schedule.h"
+
+namespace mtspin {
+
+/// @brief The Configuration Blob class.
+/// The stored configuration is kept in one of two banks. A blob is uploaded in chunks to the other bank, and is
+/// checked (version, size and CRC-16) and validated when it is committed. It is then put in use by switching the
+/// active bank, which is a single byte write, so a configuration is never partly applied, even after a reset. The
+/// blob is the image of a bank, so the active bank is exported in the same format.
+///
+/// EEPROM layout: the active bank (0 or 1; anything else means 0), then the two banks. Each bank holds the keyframe
+/// track, the schedule and the profile slots, in their own layouts. Chunk frame payload: uint16 offset, then up to
+/// kMaxSizeOfChunk_ bytes. Blob frame payload: uint8 version (kVersion_), uint16 size (kSizeOfBank_) and uint16
+/// CRC-16 (CCITT; polynomial 0x1021, initial value 0xFFFF) of the blob. Export frame payload: uint16 offset (for a
+/// chunk), or nothing (for the blob frame).
+class ConfigurationBlob {
+ public:
+
+  static const uint16_t kTrackOffset_ = 0; ///< Offset of the keyframe track in a bank.
+  static const uint16_t kScheduleOffset_ = kTrackOffset_ + KeyframeTrack::kSizeOfEeprom_; ///< Offset of the schedule in a bank.
+  static const uint16_t kProfileOffset_ = kScheduleOffset_ + Schedule::kSizeOfEeprom_; ///< Offset of the profile slots in a bank.
+  static const uint16_t kSizeOfBank_ = kProfileOffset_ + ProfileSlots::kSizeOfEeprom_; ///< Size (bytes) of a bank, and of the blob.
+  static const uint16_t kSizeOfEeprom_ = 1 + (2 * kSizeOfBank_); ///< EEPROM used by the banks (bytes).
+  static const uint8_t kMaxSizeOfChunk_ = 12; ///< Max no. of blob bytes in a chunk frame.
+
+  /// @brief Construct a Configuration Blob object.
+  /// @param eeprom_address The EEPROM address of the banks.
+  explicit ConfigurationBlob(uint16_t eeprom_address);
+
+  /// @brief Destroy the Configuration Blob object.
+  ~ConfigurationBlob();
+
+  /// @brief Read the active bank.
+  void Begin(); ///< This must be called only once.
+
+  /// @brief Store a chunk of a blob in the inactive bank; any committed blob is discarded.
+  /// @param payload The chunk frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored; false if the payload is invalid.
+  bool StoreChunk(const uint8_t* payload, uint8_t size);
+
+  /// @brief Check and validate the uploaded blob; it is put in use by Apply().
+  /// @param payload The blob frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if committed; false if the version, size or CRC is wrong, or its contents are invalid.
+  bool Commit(const uint8_t* payload, uint8_t size);
+
+  /// @brief Put the committed blob in use, by switching the active bank.
+  void Apply();
+
+  /// @brief Export a chunk of the active bank (or the blob frame).
+  /// @param payload The export frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if sent; false if the payload is invalid.
+  bool Export(const uint8_t* payload, uint8_t size) const;
+
+  /// @brief Get whether a committed blob is waiting to be applied.
+  /// @return True if waiting.
+  bool pending() const;
+
+  /// @brief Get the EEPROM address of the keyframe track in the active bank.
+  /// @return The address.
+  uint16_t track_address() const;
+
+  /// @brief Get the EEPROM address of the schedule in the active bank.
+  /// @return The address.
+  uint16_t schedule_address() const;
+
+  /// @brief Get the EEPROM address of the profile slots in the active bank.
+  /// @return The address.
+  uint16_t profile_address() const;
+
+ private:
+
+  static const uint8_t kVersion_ = 1; ///< Version of the blob layout; changes whenever a bank's layout does.
+
+  /// @brief Get the EEPROM address of a bank.
+  /// @param bank The bank (0 or 1).
+  /// @return The address.
+  uint16_t BankAddress(uint8_t bank) const;
+
+  /// @brief Compute the CRC-16 of a bank.
+  /// @param bank The bank (0 or 1).
+  /// @return The CRC.
+  uint16_t Crc(uint8_t bank) const;
+
+  uint16_t eeprom_address_; ///< The EEPROM address of the banks.
+  uint8_t bank_ = 0; ///< The active bank.
+  bool pending_ = false; ///< Whether a committed blob is waiting to be applied.
+};
+
+} // namespace mtspin
+
+#endif // CONFIGURATION_BLOB_H_
\ No newline at end of file
@@ -14,6 +14,17 @@
 #include <stepper_driver.h>
 
 #include "configuration.h"
+#include "acceleration_calibration.h"
+#include "configuration_blob.h"
+#include "frame_link.h"
+#include "gear_input.h"
+#include "keyframe_track.h"
+#include "motion_controller.h"
+#include "motion_planner.h"
+#include "profile_slots.h"
+#include "profiler.h"
+#include "pvt_stream.h"
+#include "schedule.h"
 
 namespace mtspin {
 
@@ -23,27 +34,57 @@ ControlSystem::~ControlSystem() {}
 
 void ControlSystem::Begin() {
   configuration_.BeginHardware();
+  profiler_.Begin();
   direction_button_.set_long_press_option(configuration_.kLongPressOption_);
   angle_button_.set_long_press_option(configuration_.kLongPressOption_);
   speed_button_.set_long_press_option(configuration_.kLongPressOption_);
-  stepper_driver_.set_pul_delay_us(configuration_.kPulDelay_us_);
-  stepper_driver_.set_dir_delay_us(configuration_.kDirDelay_us_);
   stepper_driver_.set_ena_delay_us(configuration_.kEnaDelay_us_);
-  stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_index_],
-                           mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-  stepper_driver_.SetAcceleration(configuration_.kAcceleration_microsteps_per_s_per_s_,
-                                  mt::StepperDriver::AccelerationUnits::kMicrostepsPerSecondPerSecond);
-  stepper_driver_.set_acceleration_algorithm(configuration_.kAccelerationAlgorithm_);
+  motion_controller_.set_pul_delay_us(configuration_.kPulDelay_us_);
+  motion_controller_.set_double_edge_stepping(configuration_.kDoubleEdgeStepping_);
+  motion_controller_.set_spi_stepping_min_step_rate(configuration_.kSpiSteppingMinStepRate_microsteps_per_s_);
+  motion_controller_.set_dir_delay_us(configuration_.kDirDelay_us_);
+  motion_controller_.set_positive_dir_pin_state(configuration_.kPositiveDirPinState_);
+  motion_controller_.set_control_period_us(configuration_.kControlPeriod_us_);
+  motion_controller_.SetAccelerations(configuration_.kAcceleration_microsteps_per_s_per_s_,
+                                      configuration_.kDeceleration_microsteps_per_s_per_s_,
+                                      configuration_.kQuickStopDeceleration_microsteps_per_s_per_s_);
+  motion_controller_.SetAccelerationCurve(configuration_.kAccelerationCurveSpeeds_RPM_,
+                                          configuration_.kAccelerationCurveScales_,
+                                          configuration_.kSizeOfAccelerationCurve_);
+  motion_controller_.SetInputShaper(configuration_.kInputShaperType_, configuration_.kInputShaperFrequency_Hz_,
+                                    configuration_.kInputShaperDampingRatio_);
+  motion_controller_.SetCoggingCorrections(configuration_.kCoggingCorrections_,
+                                           configuration_.kSizeOfCoggingCorrections_);
+  motion_controller_.Begin(configuration_.kStepTickRate_Hz_, configuration_.kMaxStepSmoothingLevel_);
+  gear_input_.Begin(configuration_.kGearInputDirPin_, configuration_.kGearInputPositiveDirPinState_,
+                    configuration_.kElectronicGearNumerator_, configuration_.kElectronicGearDenominator_);
   stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
+  configuration_blob_.Begin();
+  UseActiveBank();
+  LimitSpeedsToMeasuredStepRate();
+  SelectProfile(0, true);
+  schedule_.Load();
   LogGeneralStatus(); // Log initial status of control system.
 }
 
 void ControlSystem::CheckAndProcess() {
+  uint32_t loop_start_cycles = profiler_.ReadCycles();
+  uint32_t section_start_cycles = loop_start_cycles;
+  Configuration::ControlMode start_control_mode = control_mode_;
+  mt::StepperDriver::PowerState start_power_state = stepper_driver_.power_state();
+  MotionPlanner::MotionStatus start_motion_status = motion_status_;
 
   // Check for button presses.
   mt::MomentaryButton::PressType direction_button_press_type = direction_button_.DetectPressType();
   mt::MomentaryButton::PressType angle_button_press_type = angle_button_.DetectPressType();
   mt::MomentaryButton::PressType speed_button_press_type = speed_button_.DetectPressType();
+  if (chord_) {
+    // Ignore the buttons of a chord (e.g., the short press of a button released early) until all are released.
+    direction_button_press_type = mt::MomentaryButton::PressType::kNotPressed;
+    angle_button_press_type = mt::MomentaryButton::PressType::kNotPressed;
+    speed_button_press_type = mt::MomentaryButton::PressType::kNotPressed;
+    chord_ = (CountHeldButtons() > 0);
+  }
 
   // Process button presses, and serial input; one character at a time.
   if (direction_button_press_type == mt::MomentaryButton::PressType::kShortPress) {
@@ -61,20 +102,61 @@ void ControlSystem::CheckAndProcess() {
   else if (direction_button_press_type == mt::MomentaryButton::PressType::kLongPress 
            || angle_button_press_type == mt::MomentaryButton::PressType::kLongPress 
            || speed_button_press_type == mt::MomentaryButton::PressType::kLongPress) {
-    control_action_ = Configuration::ControlAction::kToggleMotion;
-    Log.noticeln(F("Button long press"));
+    if (CountHeldButtons() > 1) {
+      // Buttons held together (a chord) switch the profile instead.
+      control_action_ = Configuration::ControlAction::kCycleProfile;
+      chord_ = true;
+      Log.noticeln(F("Button chord"));
+    }
+    else {
+      control_action_ = Configuration::ControlAction::kToggleMotion;
+      Log.noticeln(F("Button long press"));
+    }
   }
   else if (Serial.available() > 0) {
     char serial_input = MTSPIN_SERIAL.read();
-    control_action_ = static_cast<Configuration::ControlAction>(serial_input);
-    Log.noticeln(F("Serial input: %c"), serial_input);
+    FrameLink::ParseResult parse_result = frame_link_.Parse(static_cast<uint8_t>(serial_input));
+    if (parse_result != FrameLink::ParseResult::kNotFrame) {
+      // Part of a binary frame; serial commands are still accepted between frames.
+      control_action_ = Configuration::ControlAction::kIdle;
+      if (parse_result != FrameLink::ParseResult::kInProgress) {
+        ProcessFrame(parse_result == FrameLink::ParseResult::kFrame);
+      }
+    }
+    else {
+      control_action_ = static_cast<Configuration::ControlAction>(serial_input);
+      Log.noticeln(F("Serial input: %c"), serial_input);
+    }
   }
   else {
     control_action_ = Configuration::ControlAction::kIdle;
+    // A frame cut short is rejected once the serial line has been quiet for too long.
+    if (frame_link_.CheckTimeout() == FrameLink::ParseResult::kError) ProcessFrame(false);
   }
 
+  CheckSpeedOverrideInput();
+  CheckHeartbeat();
+  CheckSchedule();
+  CheckConfigurationBlob();
+  profiler_.Record(Profiler::Section::kInput, section_start_cycles);
+  section_start_cycles = profiler_.ReadCycles();
+
   // Process control actions.
   switch(control_action_) {
+    case Configuration::ControlAction::kStreamTrajectory:
+    case Configuration::ControlAction::kPlayTrack:
+    case Configuration::ControlAction::kFollowGearInput:
+    case Configuration::ControlAction::kCalibrateAcceleration: {
+      // Change to PVT, track, gearing or calibration mode, moving from the current position, and start motor.
+      if (!SelectMode(control_action_)) break;
+      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
+        // Fall through to start motor.
+        [[fallthrough]];
+      }
+      else {
+        break;
+      }
+    }
     case Configuration::ControlAction::kToggleDirection: {
       // Start motor, change motor direction, or change to continuous mode.
       if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
@@ -97,10 +179,10 @@ void ControlSystem::CheckAndProcess() {
         else {
           // Change to continuous mode.
           control_mode_ = Configuration::ControlMode::kContinuous;
+          SelectSweepSpeed();
           Log.noticeln(F("Control mode: continuous"));
         }
 
-        motion_type_ = mt::StepperDriver::MotionType::kStopAndReset;
         break;
       }
     }
@@ -121,11 +203,12 @@ void ControlSystem::CheckAndProcess() {
             sweep_angle_index_++;
           }
 
-          Log.noticeln(F("Sweep angle (degrees): %F"), configuration_.kSweepAngles_degrees_[sweep_angle_index_]);
+          Log.noticeln(F("Sweep angle (degrees): %F"), profile_.sweep_angles_degrees[sweep_angle_index_]);
         }
         else {
           // Change to oscillation mode.
           control_mode_ = Configuration::ControlMode::kOscillate;
+          SelectSweepSpeed();
           Log.noticeln(F("Control mode: oscillate"));
         }
 
@@ -148,9 +231,8 @@ void ControlSystem::CheckAndProcess() {
           speed_index_++;
         }
         
-        stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_index_],
-                                 mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-        Log.noticeln(F("Speed (RPM): %F"), configuration_.kSpeeds_RPM_[speed_index_]);
+        ApplySpeed();
+        Log.noticeln(F("Speed (RPM): %F"), speeds_RPM_[speed_index_]);
         break;
       }
     }
@@ -159,20 +241,54 @@ void ControlSystem::CheckAndProcess() {
       if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
         // Allow movement.
         stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kEnabled); // Restore power to allow motion.
+        profiler_.ArmStepTrace();
         Log.noticeln(F("Motion status: started"));     
       }
       else {
-        // Disallow movement.
-        stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
-        speed_index_ = configuration_.kDefaultSpeedIndex_;
-        stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_index_],
-                                 mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);        
-        LogGeneralStatus();
-        Log.noticeln(F("Motion status: stopped"));       
+        // Disallow movement; decelerate to a stop before removing power.
+        motion_controller_.Stop(MotionPlanner::StopMode::kDecelerate);
+        stopping_ = true;
+        Log.noticeln(F("Motion status: stopping"));
       }
       
       break;
     }
+    case Configuration::ControlAction::kCycleProfile: {
+      // Switch to the profile in the next slot, without stopping the motor.
+      if (CanSwitchProfile()) {
+        SelectProfile((profile_slot_ + 1 < ProfileSlots::kSizeOfSlots_) ? (profile_slot_ + 1) : 0, false);
+      }
+      else {
+        Log.warningln(F("Stop before switching profile"));
+      }
+
+      break;
+    }
+    case Configuration::ControlAction::kQuickStop: {
+      // Stop the motor at the quick stop deceleration (e.g., emergency stop).
+      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled) {
+        motion_controller_.Stop(MotionPlanner::StopMode::kQuickStop);
+        stopping_ = true;
+        Log.noticeln(F("Motion status: quick stopping"));
+      }
+
+      break;
+    }
+    case Configuration::ControlAction::kIncreaseSpeedOverride: {
+      // Increase the speed override; takes effect through the acceleration, without restarting motion.
+      SetSpeedOverride(speed_override_percent_ + configuration_.kSpeedOverrideStep_percent_);
+      break;
+    }
+    case Configuration::ControlAction::kDecreaseSpeedOverride: {
+      // Decrease the speed override; takes effect through the deceleration, without restarting motion.
+      SetSpeedOverride(speed_override_percent_ - configuration_.kSpeedOverrideStep_percent_);
+      break;
+    }
+    case Configuration::ControlAction::kResetSpeedOverride: {
+      // Reset the speed override.
+      SetSpeedOverride(100);
+      break;
+    }
     case Configuration::ControlAction::kToggleLogReport: {
       // Toggle reporting/output of log messages over serial.
       configuration_.ToggleLogs();
@@ -186,6 +302,13 @@ void ControlSystem::CheckAndProcess() {
     case Configuration::ControlAction::kReportFirmwareVersion: {
       // Log/report the firmware version.
       configuration_.ReportFirmwareVersion();
+      break;
+    }
+    case Configuration::ControlAction::kReportProfile: {
+      // Report and clear the control loop cycle counts.
+      profiler_.Report();
+      profiler_.Reset();
+      break;
     }
     case Configuration::ControlAction::kIdle: {
       // No action.
@@ -198,52 +321,128 @@ void ControlSystem::CheckAndProcess() {
     }
   }
 
-  switch (control_mode_) {
-    case Configuration::ControlMode::kContinuous: {      
-      if (motion_status_ != mt::StepperDriver::MotionStatus::kConstantSpeed 
-          || motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-        // Accelerate to constant speed.
-        motion_status_ = stepper_driver_.MoveByAngle(static_cast<float>(motion_direction_) * 360.0,
-                                                     mt::StepperDriver::AngleUnits::kDegrees, motion_type_);
-        if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-          // Stop and reset issued by user changing direction, restart motion.
-          motion_type_ = mt::StepperDriver::MotionType::kRelative;
+  if (start_control_mode == Configuration::ControlMode::kCalibrate
+      && control_mode_ != Configuration::ControlMode::kCalibrate) {
+    // Calibration was abandoned for another mode; restore the stored results.
+    ApplyCalibration(false);
+    ApplySpeed();
+  }
+
+  if (control_action_ != Configuration::ControlAction::kIdle) {
+    profiler_.Record(Profiler::Section::kAction, section_start_cycles);
+  }
+
+  section_start_cycles = profiler_.ReadCycles();
+  // Process motion; only while the driver is enabled so a stopped motor is never stepped.
+  if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled) {
+    if (stopping_) {
+      // Complete the stop, then remove power.
+      motion_status_ = motion_controller_.Run();
+      if (motion_status_ == MotionPlanner::MotionStatus::kIdle) {
+        stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
+        stopping_ = false;
+        motion_type_ = mt::StepperDriver::MotionType::kStopAndReset; // Restart sweeps from the current position.
+        speed_index_ = profile_.speed_index;
+        if (control_mode_ == Configuration::ControlMode::kCalibrate) {
+          // Calibration finished (or was stopped); return to the profile, with the stored results applied.
+          SelectProfile(profile_slot_, true);
         }
-      }
-      else {
-        // Continue constant speed motion indefinitely.
-        stepper_driver_.MoveByJogging(motion_direction_);
-      }
 
-      break;
+        ApplySpeed();
+        // Restart trajectories from the current position.
+        if (control_mode_ == Configuration::ControlMode::kPvt) pvt_stream_.Begin();
+        if (control_mode_ == Configuration::ControlMode::kTrack) keyframe_track_.Load();
+        LogGeneralStatus();
+        Log.noticeln(F("Motion status: stopped"));
+      }
     }
-    case Configuration::ControlMode::kOscillate: {
-      mt::StepperDriver::MotionStatus motion_status = stepper_driver_.MoveByAngle(
-                                                      sweep_direction_ *
-                                                      configuration_.kSweepAngles_degrees_[sweep_angle_index_],
-                                                      mt::StepperDriver::AngleUnits::kDegrees, motion_type_);
-      if (motion_status == mt::StepperDriver::MotionStatus::kIdle) {
-        // Motion completed OR stop and reset issued.
-        if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-          // Stop and reset issued by user changing sweep angle, restart motion.
-          motion_type_ = mt::StepperDriver::MotionType::kRelative;
+    else {
+      switch (control_mode_) {
+        case Configuration::ControlMode::kContinuous: {
+          // Move indefinitely; direction changes decelerate through a stop before accelerating in reverse.
+          motion_status_ = motion_controller_.MoveByJogging(motion_direction_);
+          profiler_.Record(Profiler::Section::kContinuous, section_start_cycles);
+          break;
         }
-        else if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled) {
-          // Change sweep direction.
-          if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kNegative; 
-          }
-          else {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kPositive;
+        case Configuration::ControlMode::kOscillate: {
+          motion_status_ = motion_controller_.MoveByAngle(sweep_direction_ *
+                                                          profile_.sweep_angles_degrees[sweep_angle_index_],
+                                                          motion_type_);
+          if (motion_status_ == MotionPlanner::MotionStatus::kIdle) {
+            // Motion completed OR stop and reset issued.
+            if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
+              // Stop and reset issued by user changing sweep angle, restart motion.
+              motion_type_ = mt::StepperDriver::MotionType::kRelative;
+              profiler_.ArmStepTrace();
+            }
+            else {
+              // Change sweep direction.
+              if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
+                motion_direction_ = mt::StepperDriver::MotionDirection::kNegative; 
+              }
+              else {
+                motion_direction_ = mt::StepperDriver::MotionDirection::kPositive;
+              }
+
+              sweep_direction_ = static_cast<float>(motion_direction_);
+              SelectSweepSpeed(); // The plans for both directions are precomputed, so only a selection is needed.
+            }
           }
 
-          sweep_direction_ = static_cast<float>(motion_direction_);
+          profiler_.Record(Profiler::Section::kOscillate, section_start_cycles);
+          break;
+        }
+        case Configuration::ControlMode::kPvt: {
+          // Follow the streamed trajectory, and return credits for the points consumed.
+          motion_status_ = motion_controller_.MoveByTrajectory(pvt_stream_);
+          pvt_stream_.ReportCredits();
+          profiler_.Record(Profiler::Section::kTrajectory, section_start_cycles);
+          break;
+        }
+        case Configuration::ControlMode::kTrack: {
+          // Play the stored keyframe track, looping indefinitely.
+          motion_status_ = motion_controller_.MoveByTrajectory(keyframe_track_);
+          profiler_.Record(Profiler::Section::kTrajectory, section_start_cycles);
+          break;
+        }
+        case Configuration::ControlMode::kGearing: {
+          // Follow the master step/direction input at the gear ratio.
+          motion_status_ = motion_controller_.MoveByGearing(gear_input_);
+          profiler_.Record(Profiler::Section::kTrajectory, section_start_cycles);
+          break;
+        }
+        case Configuration::ControlMode::kCalibrate: {
+          // Run the calibration ramps; these are sweeps, so they are profiled with oscillation.
+          Calibrate();
+          profiler_.Record(Profiler::Section::kOscillate, section_start_cycles);
+          break;
         }
       }
-
-      break;
     }
   }
+
+  profiler_.Record(Profiler::Section::kLoop, loop_start_cycles);
+  profiler_.RecordState(start_control_mode, start_power_state, start_motion_status, loop_start_cycles);
+  CheckInvariants();
+}
+
+void ControlSystem::CheckInvariants() {
+#if defined(MTSPIN_PROFILING)
+  bool violated = false;
+  if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
+    // A disabled driver must never be marked as moving or stopping.
+    if (motion_status_ != MotionPlanner::MotionStatus::kIdle || stopping_) violated = true;
+  }
+
+  if (sweep_angle_index_ >= configuration_.kSizeOfSweepAngles_ || speed_index_ >= configuration_.kSizeOfSpeeds_) {
+    violated = true;
+  }
+
+  if (violated) {
+    profiler_.RecordInvariantViolation();
+    Log.errorln(F("Invariant violated"));
+  }
+#endif
 }
 
 void ControlSystem::LogGeneralStatus() const {
@@ -251,9 +450,23 @@ void ControlSystem::LogGeneralStatus() const {
   if (control_mode_ == Configuration::ControlMode::kContinuous) {
     Log.noticeln(F("Control mode: continuous"));
   }
-  else {
+  else if (control_mode_ == Configuration::ControlMode::kOscillate) {
     Log.noticeln(F("Control mode: oscillate"));
   }
+  else if (control_mode_ == Configuration::ControlMode::kPvt) {
+    Log.noticeln(F("Control mode: PVT"));
+    pvt_stream_.LogStatistics();
+  }
+  else if (control_mode_ == Configuration::ControlMode::kTrack) {
+    Log.noticeln(F("Control mode: track"));
+    Log.noticeln(F("Keyframes: %d"), keyframe_track_.size());
+  }
+  else if (control_mode_ == Configuration::ControlMode::kGearing) {
+    Log.noticeln(F("Control mode: gearing"));
+  }
+  else {
+    Log.noticeln(F("Control mode: calibrate"));
+  }
 
   if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
     Log.noticeln(F("Motion direction: clockwise (CW)"));
@@ -262,8 +475,425 @@ void ControlSystem::LogGeneralStatus() const {
     Log.noticeln(F("Motion direction: counter-clockwise (CCW)"));
   }
   
-  Log.noticeln(F("Sweep angle (degrees): %F"), configuration_.kSweepAngles_degrees_[sweep_angle_index_]);
-  Log.noticeln(F("Speed (RPM): %F"), configuration_.kSpeeds_RPM_[speed_index_]);
+  Log.noticeln(F("Profile slot: %d"), profile_slot_);
+  Log.noticeln(F("Sweep angle (degrees): %F"), profile_.sweep_angles_degrees[sweep_angle_index_]);
+  Log.noticeln(F("Speed (RPM): %F"), speeds_RPM_[speed_index_]);
+  Log.noticeln(F("Return speed (RPM): %F"), return_speeds_RPM_[speed_index_]);
+  Log.noticeln(F("Speed override (percent): %d"), speed_override_percent_);
+  if (speeds_RPM_[speed_index_] < profile_.speeds_RPM[speed_index_]) {
+    Log.noticeln(F("Speed limited; preset (RPM): %F, max (RPM): %F"), profile_.speeds_RPM[speed_index_],
+                 max_speed_RPM_);
+  }
+
+  if (host_control_) Log.noticeln(F("Host control; heartbeat timeout (ms): %d"), heartbeat_timeout_ms_);
+  if (schedule_.active()) Log.noticeln(F("Schedule; minute of the week: %d"), schedule_.minute_of_week());
+}
+
+void ControlSystem::ProcessFrame(bool valid) {
+  // Any valid frame shows the host is alive.
+  if (valid && host_control_) heartbeat_deadline_ms_ = millis() + heartbeat_timeout_ms_;
+  // EEPROM writes (about 3.4 ms per byte) would stall stepping, so frames that store to EEPROM are only taken with the
+  // driver disabled (the motor stopped); the host retries them once it is stopped.
+  bool storable = valid && stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled;
+  FrameLink::FrameType type = frame_link_.type();
+  switch (type) {
+    case FrameLink::FrameType::kPoint: {
+      // Points are only taken in PVT mode; flow control (credits) replaces acknowledgements.
+      if (control_mode_ != Configuration::ControlMode::kPvt) break;
+      if (valid) pvt_stream_.Queue(frame_link_.payload(), frame_link_.payload_size());
+      else pvt_stream_.Reject();
+      break;
+    }
+    case FrameLink::FrameType::kKeyframe: {
+      FrameLink::Acknowledge(type, storable && keyframe_track_.StoreKeyframe(frame_link_.payload(),
+                                                                             frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kTrack: {
+      FrameLink::Acknowledge(type, storable && keyframe_track_.StoreLength(frame_link_.payload(),
+                                                                           frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kClock: {
+      FrameLink::Acknowledge(type, valid && schedule_.SetClock(frame_link_.payload(), frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kScheduleEntry: {
+      FrameLink::Acknowledge(type, storable && schedule_.StoreEntry(frame_link_.payload(),
+                                                                    frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kSchedule: {
+      FrameLink::Acknowledge(type, storable && schedule_.StoreLength(frame_link_.payload(),
+                                                                     frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kProfilePart: {
+      FrameLink::Acknowledge(type, storable && profile_slots_.StorePart(frame_link_.payload(),
+                                                                        frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kProfile: {
+      bool applied = storable && profile_slots_.StoreProfile(frame_link_.payload(), frame_link_.payload_size());
+      FrameLink::Acknowledge(type, applied);
+      // Speeds above the max speed are reported once, when stored (the motor is stopped), rather than at each switch.
+      ProfileSlots::Profile profile;
+      if (applied && profile_slots_.Load(frame_link_.payload()[0], profile)) LogSpeedLimits(profile);
+      break;
+    }
+    case FrameLink::FrameType::kSelectProfile: {
+      bool applied = valid && frame_link_.payload_size() == 1 && frame_link_.payload()[0] < ProfileSlots::kSizeOfSlots_
+                     && CanSwitchProfile();
+      if (applied) SelectProfile(frame_link_.payload()[0], false);
+      FrameLink::Acknowledge(type, applied);
+      break;
+    }
+    case FrameLink::FrameType::kConfigurationChunk: {
+      FrameLink::Acknowledge(type, storable && configuration_blob_.StoreChunk(frame_link_.payload(),
+                                                                              frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kConfiguration: {
+      // Applied once the motor is stopped (see CheckConfigurationBlob()).
+      FrameLink::Acknowledge(type, valid && configuration_blob_.Commit(frame_link_.payload(),
+                                                                       frame_link_.payload_size()));
+      break;
+    }
+    case FrameLink::FrameType::kExportConfiguration: {
+      // The exported frame is the reply; only a rejected request is acknowledged.
+      if (!valid || !configuration_blob_.Export(frame_link_.payload(), frame_link_.payload_size())) {
+        FrameLink::Acknowledge(type, false);
+      }
+
+      break;
+    }
+    case FrameLink::FrameType::kHeartbeat: {
+      // Start host control (or end it, with a timeout of 0), or just refresh the heartbeat.
+      bool applied = valid && frame_link_.payload_size() == 2;
+      if (applied) {
+        heartbeat_timeout_ms_ = FrameLink::ReadUint16(frame_link_.payload());
+        heartbeat_deadline_ms_ = millis() + heartbeat_timeout_ms_;
+        host_control_ = (heartbeat_timeout_ms_ > 0);
+      }
+
+      FrameLink::Acknowledge(type, applied);
+      break;
+    }
+    default: {
+      FrameLink::Acknowledge(type, false);
+      break;
+    }
+  }
+}
+
+bool ControlSystem::SelectMode(Configuration::ControlAction control_action) {
+  if (control_action == Configuration::ControlAction::kStreamTrajectory) {
+#if defined(MTSPIN_PVT_STREAMING)
+    // Start with an empty trajectory; the host is granted credits to fill it.
+    if (control_mode_ == Configuration::ControlMode::kPvt) return true;
+    control_mode_ = Configuration::ControlMode::kPvt;
+    pvt_stream_.Begin();
+    Log.noticeln(F("Control mode: PVT"));
+#else
+    Log.warningln(F("PVT streaming is not enabled (MTSPIN_PVT_STREAMING)"));
+    return false;
+#endif
+  }
+  else if (control_action == Configuration::ControlAction::kPlayTrack) {
+    if (control_mode_ == Configuration::ControlMode::kTrack) return true;
+    control_mode_ = Configuration::ControlMode::kTrack;
+    if (!keyframe_track_.Load()) Log.warningln(F("No keyframe track stored"));
+    Log.noticeln(F("Control mode: track"));
+  }
+  else if (control_action == Configuration::ControlAction::kFollowGearInput) {
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+    if (control_mode_ == Configuration::ControlMode::kGearing) return true;
+    control_mode_ = Configuration::ControlMode::kGearing;
+    Log.noticeln(F("Control mode: gearing"));
+#else
+    Log.warningln(F("Electronic gearing is not enabled (MTSPIN_ELECTRONIC_GEARING)"));
+    return false;
+#endif
+  }
+  else {
+    if (!configuration_.kIndexSensor_) {
+      Log.warningln(F("No index sensor fitted (kIndexSensor_)"));
+      return false;
+    }
+
+    if (control_mode_ == Configuration::ControlMode::kCalibrate) return true;
+    // Start from the lowest level, scaling from the configured acceleration and the fastest speed in use.
+    float speed_RPM = 0.0F;
+    for (uint8_t i = 0; i < configuration_.kSizeOfSpeeds_; i++) {
+      if (profile_.speeds_RPM[i] > speed_RPM) speed_RPM = profile_.speeds_RPM[i];
+      if (profile_.return_speeds_RPM[i] > speed_RPM) speed_RPM = profile_.return_speeds_RPM[i];
+    }
+
+    acceleration_calibration_.Begin(configuration_.kAcceleration_microsteps_per_s_per_s_,
+                                    speed_RPM * configuration_.kMaxSpeedOverride_percent_ / 100.0F,
+                                    step_rate_max_speed_RPM_, motion_controller_.microsteps_per_revolution(),
+                                    configuration_.kMicrostepMode_, configuration_.kCalibrationMargin_);
+    control_mode_ = Configuration::ControlMode::kCalibrate;
+    ApplyAccelerations(acceleration_calibration_.acceleration());
+    motion_controller_.SetSpeed(acceleration_calibration_.speed_RPM());
+    motion_type_ = mt::StepperDriver::MotionType::kStopAndReset; // Stop any motion before the first ramp.
+    Log.noticeln(F("Control mode: calibrate"));
+  }
+
+  return true;
+}
+
+void ControlSystem::ApplySpeed() {
+  // Precompute the speeds for both sweep directions, so reversals only select one.
+  float speed_RPM = speeds_RPM_[speed_index_] * speed_override_percent_ / 100.0F;
+  sweep_speeds_RPM_[0] = (speed_RPM > max_speed_RPM_) ? max_speed_RPM_ : speed_RPM;
+  speed_RPM = return_speeds_RPM_[speed_index_] * speed_override_percent_ / 100.0F;
+  sweep_speeds_RPM_[1] = (speed_RPM > max_speed_RPM_) ? max_speed_RPM_ : speed_RPM;
+  SelectSweepSpeed();
+  motion_controller_.set_step_dither(configuration_.kSpeedDithers_[speed_index_]);
+}
+
+void ControlSystem::SelectSweepSpeed() {
+  if (control_mode_ == Configuration::ControlMode::kCalibrate) return; // Calibration sets the speed of each level.
+  bool returning = (control_mode_ == Configuration::ControlMode::kOscillate
+                    && motion_direction_ == mt::StepperDriver::MotionDirection::kNegative);
+  motion_controller_.SetSpeed(sweep_speeds_RPM_[returning ? 1 : 0]);
+}
+
+void ControlSystem::SetSpeedOverride(int16_t speed_override_percent) {
+  speed_override_percent = constrain(speed_override_percent, configuration_.kMinSpeedOverride_percent_,
+                                     configuration_.kMaxSpeedOverride_percent_);
+  if (speed_override_percent == speed_override_percent_) return;
+  speed_override_percent_ = static_cast<uint8_t>(speed_override_percent);
+  ApplySpeed();
+  Log.noticeln(F("Speed override (percent): %d"), speed_override_percent_);
+}
+
+void ControlSystem::CheckSpeedOverrideInput() {
+  if (!configuration_.kAnalogSpeedOverride_) return;
+  uint32_t now_ms = millis();
+  if (now_ms - last_speed_override_sample_ms_ < configuration_.kSpeedOverrideSamplePeriod_ms_) return;
+  last_speed_override_sample_ms_ = now_ms;
+
+  // Map the full input range onto the override range.
+  int32_t input = analogRead(configuration_.kSpeedOverridePin_);
+  int32_t speed_override_range = configuration_.kMaxSpeedOverride_percent_ - configuration_.kMinSpeedOverride_percent_;
+  int16_t speed_override_percent = configuration_.kMinSpeedOverride_percent_ + ((input * speed_override_range) / 1023);
+
+  // Ignore single percent changes (input noise).
+  if (abs(speed_override_percent - speed_override_percent_) > 1) SetSpeedOverride(speed_override_percent);
+}
+
+void ControlSystem::CheckHeartbeat() {
+  // The deadline is only moved when a frame arrives, so each loop costs a single timestamp compare.
+  if (!host_control_ || static_cast<int32_t>(millis() - heartbeat_deadline_ms_) < 0) return;
+  host_control_ = false;
+  Log.warningln(F("Host heartbeat lost"));
+  if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled && !stopping_) {
+    // Decelerate to a stop before removing power.
+    motion_controller_.Stop(MotionPlanner::StopMode::kDecelerate);
+    stopping_ = true;
+    Log.noticeln(F("Motion status: stopping"));
+  }
+}
+
+void ControlSystem::CheckSchedule() {
+  // The schedule is only evaluated at a transition, so each loop costs a single timestamp compare. A transition is
+  // left pending while the motor is stopping, or another action was read in this loop, so neither is lost.
+  if (!schedule_.Due() || stopping_ || control_action_ != Configuration::ControlAction::kIdle) return;
+  bool run = schedule_.Advance();
+  bool enabled = (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled);
+  if (run == enabled) return;
+
+  // Start or stop the motor, as if toggled by a button or serial command.
+  control_action_ = Configuration::ControlAction::kToggleMotion;
+  if (run) Log.noticeln(F("Schedule: open"));
+  else Log.noticeln(F("Schedule: closed"));
+}
+
+void ControlSystem::CheckConfigurationBlob() {
+  // Nothing moves while the banks are switched, so the motor never runs on a partly applied configuration.
+  if (!configuration_blob_.pending() || stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled) {
+    return;
+  }
+
+  configuration_blob_.Apply();
+  UseActiveBank();
+  Log.noticeln(F("Configuration applied"));
+  SelectProfile(0, true);
+  keyframe_track_.Load();
+  schedule_.Load();
+}
+
+void ControlSystem::UseActiveBank() {
+  keyframe_track_.set_eeprom_address(configuration_blob_.track_address());
+  schedule_.set_eeprom_address(configuration_blob_.schedule_address());
+  profile_slots_.set_eeprom_address(configuration_blob_.profile_address());
+}
+
+void ControlSystem::LimitSpeedsToMeasuredStepRate() {
+  const float microsteps_per_revolution = (360.0F / configuration_.kFullStepAngle_degrees_)
+                                          * configuration_.kMicrostepMode_ * configuration_.kGearRatioNumerator_
+                                          / configuration_.kGearRatioDenominator_;
+
+  // Time the worst-case control loop: a jog that accelerates throughout (towards a speed it never reaches), shaped
+  // and dithered, stepping every iteration. The driver is disabled, so the motor does not move.
+  motion_controller_.SetSpeed(1000000.0F);
+  uint32_t start_time_us = micros();
+  for (uint16_t i = 0; i < configuration_.kSelfTestIterations_; i++) {
+    direction_button_.DetectPressType();
+    angle_button_.DetectPressType();
+    speed_button_.DetectPressType();
+    MTSPIN_SERIAL.available();
+    motion_controller_.StepForTiming();
+  }
+
+  float loop_period_us = static_cast<float>(micros() - start_time_us) / configuration_.kSelfTestIterations_;
+  motion_controller_.EndTiming(); // The speed is set when the profile is selected.
+
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  // At most one step is taken every other step generator tick (every tick with double-edge stepping), regardless of
+  // the loop period.
+  float max_step_rate = configuration_.kDoubleEdgeStepping_ ? static_cast<float>(configuration_.kStepTickRate_Hz_)
+                                                            : (configuration_.kStepTickRate_Hz_ / 2.0F);
+#else
+  // At most one step is taken per loop iteration.
+  float max_step_rate = 1000000.0F / loop_period_us;
+#endif
+  step_rate_max_speed_RPM_ = configuration_.kStepRateMargin_ * 60.0F * max_step_rate / microsteps_per_revolution;
+  Log.noticeln(F("Measured loop period (us): %F, max speed (RPM): %F"), loop_period_us, step_rate_max_speed_RPM_);
+}
+
+void ControlSystem::Calibrate() {
+  // Ramps only start once any earlier motion has stopped, so the index passes are only checked during ramps.
+  if (motion_type_ == mt::StepperDriver::MotionType::kRelative) {
+    acceleration_calibration_.CheckIndex(digitalRead(configuration_.kIndexSensorPin_)
+                                         == configuration_.kIndexSensorActiveState_,
+                                         motion_controller_.position());
+  }
+
+  motion_status_ = motion_controller_.MoveByAngle(acceleration_calibration_.direction()
+                                                  * AccelerationCalibration::kRampAngle_degrees_, motion_type_);
+  if (motion_status_ != MotionPlanner::MotionStatus::kIdle) return;
+  if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
+    // Earlier motion stopped; start the first ramp.
+    motion_type_ = mt::StepperDriver::MotionType::kRelative;
+    return;
+  }
+
+  AccelerationCalibration::Status status = acceleration_calibration_.EndRamp();
+  if (status == AccelerationCalibration::Status::kRunning) {
+    ApplyAccelerations(acceleration_calibration_.acceleration());
+    motion_controller_.SetSpeed(acceleration_calibration_.speed_RPM());
+    return;
+  }
+
+  if (status == AccelerationCalibration::Status::kDone) Log.noticeln(F("Calibration done"));
+  else Log.errorln(F("Calibration failed; steps lost at the lowest level, or the index was not found"));
+  // Remove power; the results are applied once stopped.
+  stopping_ = true;
+}
+
+void ControlSystem::ApplyAccelerations(float acceleration) {
+  float deceleration = configuration_.kDeceleration_microsteps_per_s_per_s_ * acceleration
+                       / configuration_.kAcceleration_microsteps_per_s_per_s_;
+  float quick_stop_deceleration = configuration_.kQuickStopDeceleration_microsteps_per_s_per_s_;
+  motion_controller_.SetAccelerations(acceleration, deceleration,
+                                      (quick_stop_deceleration > deceleration) ? quick_stop_deceleration : deceleration);
+}
+
+void ControlSystem::ApplyCalibration(bool log) {
+  float acceleration = configuration_.kAcceleration_microsteps_per_s_per_s_;
+  float speed_RPM = step_rate_max_speed_RPM_;
+  bool calibrated = acceleration_calibration_.Load(acceleration, speed_RPM);
+  if (calibrated && log) Log.noticeln(F("Calibrated acceleration: %F, top speed (RPM): %F"), acceleration, speed_RPM);
+
+  // A profile's own acceleration replaces the configured one, but never exceeds the calibrated one.
+  if (profile_.acceleration > 0.0F && (!calibrated || profile_.acceleration < acceleration)) {
+    acceleration = profile_.acceleration;
+  }
+
+  ApplyAccelerations(acceleration);
+  max_speed_RPM_ = (speed_RPM < step_rate_max_speed_RPM_) ? speed_RPM : step_rate_max_speed_RPM_;
+
+  // Clamp the speeds to the max speed.
+  for (uint8_t i = 0; i < configuration_.kSizeOfSpeeds_; i++) {
+    speeds_RPM_[i] = (profile_.speeds_RPM[i] > max_speed_RPM_) ? max_speed_RPM_ : profile_.speeds_RPM[i];
+    return_speeds_RPM_[i] = (profile_.return_speeds_RPM[i] > max_speed_RPM_) ? max_speed_RPM_
+                                                                              : profile_.return_speeds_RPM[i];
+  }
+
+  if (log) LogSpeedLimits(profile_);
+}
+
+void ControlSystem::LogSpeedLimits(const ProfileSlots::Profile& profile) const {
+  for (uint8_t i = 0; i < configuration_.kSizeOfSpeeds_; i++) {
+    if (profile.speeds_RPM[i] > max_speed_RPM_) {
+      Log.warningln(F("Speed (RPM) %F limited to %F"), profile.speeds_RPM[i], max_speed_RPM_);
+    }
+
+    if (profile.return_speeds_RPM[i] > max_speed_RPM_) {
+      Log.warningln(F("Return speed (RPM) %F limited to %F"), profile.return_speeds_RPM[i], max_speed_RPM_);
+    }
+  }
+}
+
+void ControlSystem::SelectProfile(uint8_t slot, bool log) {
+  // Start from the configured profile; a stored profile replaces it.
+  if (configuration_.kDefaultControlMode_ == Configuration::ControlMode::kOscillate) {
+    profile_.mode = ProfileSlots::Mode::kOscillate;
+  }
+  else if (configuration_.kDefaultControlMode_ == Configuration::ControlMode::kTrack) {
+    profile_.mode = ProfileSlots::Mode::kTrack;
+  }
+  else {
+    profile_.mode = ProfileSlots::Mode::kContinuous;
+  }
+
+  profile_.direction = static_cast<int8_t>(configuration_.kDefaultMotionDirection_);
+  profile_.speed_index = configuration_.kDefaultSpeedIndex_;
+  profile_.sweep_angle_index = configuration_.kDefaultSweepAngleIndex_;
+  profile_.acceleration = 0.0F;
+  for (uint8_t i = 0; i < ProfileSlots::kSizeOfTables_; i++) {
+    profile_.speeds_RPM[i] = configuration_.kSpeeds_RPM_[i];
+    profile_.return_speeds_RPM[i] = configuration_.kReturnSpeeds_RPM_[i];
+    profile_.sweep_angles_degrees[i] = configuration_.kSweepAngles_degrees_[i];
+  }
+
+  if (!profile_slots_.Load(slot, profile_) && slot > 0 && log) {
+    Log.warningln(F("No profile stored in slot %d; using the configured profile"), slot);
+  }
+
+  profile_slot_ = slot;
+  ApplyCalibration(log);
+  motion_direction_ = static_cast<mt::StepperDriver::MotionDirection>(profile_.direction);
+  sweep_direction_ = static_cast<float>(motion_direction_);
+  speed_index_ = profile_.speed_index;
+  sweep_angle_index_ = profile_.sweep_angle_index;
+  motion_type_ = mt::StepperDriver::MotionType::kStopAndReset; // Restart sweeps from the current position.
+  if (profile_.mode == ProfileSlots::Mode::kTrack) {
+    SelectMode(Configuration::ControlAction::kPlayTrack);
+  }
+  else {
+    control_mode_ = (profile_.mode == ProfileSlots::Mode::kOscillate) ? Configuration::ControlMode::kOscillate
+                                                                        : Configuration::ControlMode::kContinuous;
+  }
+
+  ApplySpeed();
+  if (log) Log.noticeln(F("Profile slot: %d"), profile_slot_);
+}
+
+bool ControlSystem::CanSwitchProfile() const {
+  bool following = (control_mode_ == Configuration::ControlMode::kPvt
+                    || control_mode_ == Configuration::ControlMode::kGearing);
+  return !following || stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled;
+}
+
+uint8_t ControlSystem::CountHeldButtons() const {
+  uint8_t pressed_pin_state = (configuration_.kUnpressedPinState_ == mt::MomentaryButton::PinState::kLow) ? HIGH : LOW;
+  return (digitalRead(configuration_.kDirectionButtonPin_) == pressed_pin_state)
+         + (digitalRead(configuration_.kAngleButtonPin_) == pressed_pin_state)
+         + (digitalRead(configuration_.kSpeedButtonPin_) == pressed_pin_state);
 }
 
 } // namespace mtspin
\ No newline at end of file
@@ -14,6 +14,17 @@
 #include <stepper_driver.h>
 
 #include "configuration.h"
+#include "acceleration_calibration.h"
+#include "configuration_blob.h"
+#include "frame_link.h"
+#include "gear_input.h"
+#include "keyframe_track.h"
+#include "motion_controller.h"
+#include "motion_planner.h"
+#include "profile_slots.h"
+#include "profiler.h"
+#include "pvt_stream.h"
+#include "schedule.h"
 
 namespace mtspin {
 
@@ -38,9 +49,89 @@ class ControlSystem {
   /// @brief Log/report the general status of the control system.
   void LogGeneralStatus() const;
 
+  /// @brief Process a received binary frame.
+  /// @param valid Whether the frame is valid (i.e., its CRC and size are correct).
+  void ProcessFrame(bool valid);
+
+  /// @brief Change to the mode (PVT, track, gearing or calibration) of a control action, if not already in it.
+  /// @param control_action The control action (kStreamTrajectory, kPlayTrack, kFollowGearInput or
+  /// kCalibrateAcceleration).
+  /// @return True if in the mode; false if it is not available.
+  bool SelectMode(Configuration::ControlAction control_action);
+
+  /// @brief Run the calibration ramps, checking the index sensor, and move through the calibration levels.
+  void Calibrate();
+
+  /// @brief Set the accelerations; the deceleration is scaled with the acceleration.
+  /// @param acceleration The acceleration (microsteps per second-squared).
+  void ApplyAccelerations(float acceleration);
+
+  /// @brief Apply the stored acceleration calibration (or the configured acceleration, if not calibrated), and limit
+  /// the profile's acceleration to the calibrated acceleration and its speeds to the calibrated top speed and the
+  /// measured max speed.
+  /// @param log Whether to log the calibration and the limited speeds (not while moving, as logging blocks the loop).
+  void ApplyCalibration(bool log);
+
+  /// @brief Log the speeds of a profile that are limited to the max speed.
+  /// @param profile The profile.
+  void LogSpeedLimits(const ProfileSlots::Profile& profile) const;
+
+  /// @brief Switch to the profile in a slot (or the configured profile, if none is stored), while moving or stopped.
+  /// Switching during calibration abandons it, like changing mode.
+  /// @param slot The slot.
+  /// @param log Whether to log the switch and the limited speeds (at startup or when stopped); a switch while moving is
+  /// silent, so it takes effect without blocking the loop.
+  void SelectProfile(uint8_t slot, bool log);
+
+  /// @brief Check whether the profile can be switched; not while moving in PVT or gearing mode, as the profile would
+  /// take over from the streamed or followed setpoint.
+  /// @return True if the profile can be switched.
+  bool CanSwitchProfile() const;
+
+  /// @brief Count the buttons held down, e.g., to detect a chord (buttons pressed together).
+  /// @return The no. of buttons held down.
+  uint8_t CountHeldButtons() const;
+
+  /// @brief Set the motion speed to the selected speed, scaled by the speed override (and limited to the max speed).
+  void ApplySpeed();
+
+  /// @brief Set the motion speed to the precomputed speed for the current sweep (or continuous) direction.
+  /// During oscillation, negative sweeps use the return speed; otherwise, the selected speed is used.
+  void SelectSweepSpeed();
+
+  /// @brief Set the speed override.
+  /// @param speed_override_percent The speed override (% of the selected speed); limited to the override range.
+  void SetSpeedOverride(int16_t speed_override_percent);
+
+  /// @brief Sample the analog speed override input, if enabled, and apply any change.
+  void CheckSpeedOverrideInput();
+
+  /// @brief Stop the motor under host control if no valid frame has arrived within the heartbeat timeout.
+  void CheckHeartbeat();
+
+  /// @brief Start or stop the motor at a transition of the operating schedule.
+  void CheckSchedule();
+
+  /// @brief Apply a committed configuration blob, once the motor is stopped.
+  void CheckConfigurationBlob();
+
+  /// @brief Point the keyframe track, schedule and profile slots at the active configuration bank.
+  void UseActiveBank();
+
+  /// @brief Measure the achievable step rate, which the speeds are limited to (see ApplyCalibration()).
+  /// The worst-case loop (input checks, plus a jog's plan update and a step) is timed with the driver disabled.
+  /// Speeds above the measured limit are clamped to the highest safe speed.
+  void LimitSpeedsToMeasuredStepRate();
+
+  /// @brief Check the control system invariants and record any violations (only when MTSPIN_PROFILING is defined).
+  void CheckInvariants();
+
   /// @brief Configuration settings.
   Configuration& configuration_ = Configuration::GetInstance();
 
+  /// @brief Cycle counter for the control loop (no-op unless MTSPIN_PROFILING is defined).
+  Profiler profiler_;
+
   // Buttons to control the motor.
   mt::MomentaryButton direction_button_{configuration_.kDirectionButtonPin_,
                         configuration_.kUnpressedPinState_,
@@ -58,13 +149,44 @@ class ControlSystem {
                     configuration_.kShortPressPeriod_ms_,
                     configuration_.kLongPressPeriod_ms_}; ///< Button to control motor speed.
 
+  /// @brief Binary frames (e.g., trajectory points) received and sent alongside the serial commands.
+  FrameLink frame_link_;
+
+  /// @brief Streamed trajectory for PVT mode (if MTSPIN_PVT_STREAMING is defined).
+  PvtStream pvt_stream_;
+
+  /// @brief Stored configuration (keyframe track, schedule and profile slots) banks, for bulk upload and export.
+  ConfigurationBlob configuration_blob_{configuration_.kBlobEepromAddress_};
+
+  /// @brief Stored keyframe track for track mode.
+  KeyframeTrack keyframe_track_{configuration_blob_.track_address()};
+
+  /// @brief External step/direction input for gearing mode (if MTSPIN_ELECTRONIC_GEARING is defined).
+  GearInput gear_input_;
+
+  /// @brief Acceleration calibration against the index sensor, for calibration mode.
+  AccelerationCalibration acceleration_calibration_{configuration_.kCalibrationEepromAddress_};
+
+  /// @brief Weekly operating schedule, followed once the clock is set by the host.
+  Schedule schedule_{configuration_blob_.schedule_address()};
+
+  /// @brief Stored operating profiles.
+  ProfileSlots profile_slots_{configuration_blob_.profile_address()};
+
   // Stepper motor driver.
   mt::StepperDriver stepper_driver_{configuration_.kPulPin_,
                       configuration_.kDirPin_,
                       configuration_.kEnaPin_,
                       configuration_.kMicrostepMode_,
                       configuration_.kFullStepAngle_degrees_,
-                      configuration_.kGearRatio_}; ///< Stepper motor driver to control the stepper motor.
+                      static_cast<float>(configuration_.kGearRatioNumerator_)
+                      / configuration_.kGearRatioDenominator_}; ///< Stepper motor driver to control the stepper motor power (ENA).
+  MotionController motion_controller_{configuration_.kPulPin_,
+                                      configuration_.kDirPin_,
+                                      configuration_.kMicrostepMode_,
+                                      configuration_.kFullStepAngle_degrees_,
+                                      configuration_.kGearRatioNumerator_,
+                                      configuration_.kGearRatioDenominator_}; ///< Motion controller to move the stepper motor.
 
   // Control flags and indicator variables.
   Configuration::ControlMode control_mode_ = configuration_.kDefaultControlMode_; ///< Variable to keep track of the control system mode.
@@ -74,7 +196,21 @@ class ControlSystem {
   float sweep_direction_ = static_cast<float>(motion_direction_); ///< Variable to keep track of the sweep direction.
   uint8_t sweep_angle_index_ = configuration_.kDefaultSweepAngleIndex_; ///< Index to keep track of the sweep angle set from the lookup table.
   uint8_t speed_index_ = configuration_.kDefaultSpeedIndex_; ///< Index to keep track of the motor speed set from the lookup table.
-  mt::StepperDriver::MotionStatus motion_status_ = mt::StepperDriver::MotionStatus::kIdle; ///< Variable to keep track of the motion status.
+  ProfileSlots::Profile profile_; ///< The profile in use (as stored; see speeds_RPM_ and return_speeds_RPM_ for the limited speeds).
+  uint8_t profile_slot_ = 0; ///< Slot of the profile in use.
+  bool chord_ = false; ///< Whether a button chord is held; its buttons are ignored until all are released.
+  float speeds_RPM_[Configuration::kSizeOfSpeeds_]; ///< Lookup table for rotation speeds (RPM) of the profile, limited to the max speed.
+  float return_speeds_RPM_[Configuration::kSizeOfSpeeds_]; ///< Lookup table for return (negative sweep) speeds (RPM) of the profile, limited to the max speed.
+  float sweep_speeds_RPM_[2] = {0.0F, 0.0F}; ///< Applied speeds (RPM) for positive/continuous motion and for negative sweeps.
+  float step_rate_max_speed_RPM_ = 0.0F; ///< Max speed (RPM) of the step rate measured at startup.
+  float max_speed_RPM_ = 0.0F; ///< Max speed (RPM); the measured max speed, or the calibrated top speed if lower.
+  uint8_t speed_override_percent_ = 100; ///< Variable to keep track of the speed override (% of the selected speed).
+  uint32_t last_speed_override_sample_ms_ = 0; ///< Time (ms) of the last analog speed override sample.
+  MotionPlanner::MotionStatus motion_status_ = MotionPlanner::MotionStatus::kIdle; ///< Variable to keep track of the motion status.
+  bool stopping_ = false; ///< Variable to keep track of a stop in progress; power is removed once the motor has stopped.
+  bool host_control_ = false; ///< Whether under host control; the motor is stopped if the host heartbeat is lost.
+  uint16_t heartbeat_timeout_ms_ = 0; ///< Max time (ms) between valid frames under host control.
+  uint32_t heartbeat_deadline_ms_ = 0; ///< Time (ms) by which the next valid frame must arrive under host control.
 };
 
 } // namespace mtspin
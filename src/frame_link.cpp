@@ -0,0 +1,129 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file frame_link.cpp
+/// @brief Class to send and receive binary frames over the serial port, alongside the serial commands.
+
+#include "frame_link.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+namespace mtspin {
+
+FrameLink::FrameLink() {}
+
+FrameLink::~FrameLink() {}
+
+FrameLink::ParseResult FrameLink::Parse(uint8_t byte) {
+  last_byte_time_ms_ = millis();
+  switch (parse_state_) {
+    case ParseState::kIdle: {
+      if (byte != kFrameStart_) return ParseResult::kNotFrame;
+      parse_state_ = ParseState::kType;
+      break;
+    }
+    case ParseState::kType: {
+      type_ = static_cast<FrameType>(byte);
+      crc_ = UpdateCrc(0, byte);
+      parse_state_ = ParseState::kSize;
+      break;
+    }
+    case ParseState::kSize: {
+      if (byte > kMaxSizeOfPayload_) {
+        // Not a frame that fits; wait for the next frame start byte.
+        parse_state_ = ParseState::kIdle;
+        return ParseResult::kError;
+      }
+
+      payload_size_ = byte;
+      received_size_ = 0;
+      crc_ = UpdateCrc(crc_, byte);
+      parse_state_ = (payload_size_ > 0) ? ParseState::kPayload : ParseState::kCrc;
+      break;
+    }
+    case ParseState::kPayload: {
+      payload_[received_size_++] = byte;
+      crc_ = UpdateCrc(crc_, byte);
+      if (received_size_ == payload_size_) parse_state_ = ParseState::kCrc;
+      break;
+    }
+    case ParseState::kCrc: {
+      parse_state_ = ParseState::kIdle;
+      return (byte == crc_) ? ParseResult::kFrame : ParseResult::kError;
+    }
+  }
+
+  return ParseResult::kInProgress;
+}
+
+FrameLink::ParseResult FrameLink::CheckTimeout() {
+  if (parse_state_ == ParseState::kIdle || (millis() - last_byte_time_ms_) <= kInterByteTimeout_) {
+    return ParseResult::kNotFrame;
+  }
+
+  // The rest of the frame is not coming (e.g., the host crashed, or the start byte was a stray byte), so the next
+  // bytes are parsed as serial commands, or as the start of a new frame.
+  bool type_received = (parse_state_ != ParseState::kType);
+  parse_state_ = ParseState::kIdle;
+  return type_received ? ParseResult::kError : ParseResult::kNotFrame;
+}
+
+FrameLink::FrameType FrameLink::type() const {
+  return type_;
+}
+
+const uint8_t* FrameLink::payload() const {
+  return payload_;
+}
+
+uint8_t FrameLink::payload_size() const {
+  return payload_size_;
+}
+
+void FrameLink::Send(FrameType type, const uint8_t* payload, uint8_t size) {
+  uint8_t type_byte = static_cast<uint8_t>(type);
+  uint8_t crc = UpdateCrc(UpdateCrc(0, type_byte), size);
+  MTSPIN_SERIAL.write(kFrameStart_);
+  MTSPIN_SERIAL.write(type_byte);
+  MTSPIN_SERIAL.write(size);
+  for (uint8_t i = 0; i < size; i++) {
+    MTSPIN_SERIAL.write(payload[i]);
+    crc = UpdateCrc(crc, payload[i]);
+  }
+
+  MTSPIN_SERIAL.write(crc);
+}
+
+void FrameLink::Acknowledge(FrameType type, bool applied) {
+  uint8_t type_byte = static_cast<uint8_t>(type);
+  Send(applied ? FrameType::kAcknowledge : FrameType::kNegativeAcknowledge, &type_byte, 1);
+}
+
+uint16_t FrameLink::ReadUint16(const uint8_t* bytes) {
+  return static_cast<uint16_t>(bytes[0] | (static_cast<uint16_t>(bytes[1]) << 8));
+}
+
+uint32_t FrameLink::ReadUint32(const uint8_t* bytes) {
+  return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8)
+         | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+void FrameLink::WriteUint16(uint16_t value, uint8_t* bytes) {
+  bytes[0] = static_cast<uint8_t>(value);
+  bytes[1] = static_cast<uint8_t>(value >> 8);
+}
+
+uint8_t FrameLink::UpdateCrc(uint8_t crc, uint8_t byte) {
+  crc ^= byte;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+  }
+
+  return crc;
+}
+
+} // namespace mtspin
\ No newline at end of file
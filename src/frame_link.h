@@ -0,0 +1,139 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file frame_link.h
+/// @brief Class to send and receive binary frames over the serial port, alongside the serial commands.
+
+#ifndef FRAME_LINK_H_
+#define FRAME_LINK_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The Frame Link class.
+/// Frames are: the start byte (kFrameStart_), the frame type, the payload size, the payload (little-endian) and a
+/// CRC-8 (polynomial 0x07, initial value 0) of the type, size and payload. The start byte is never a serial command
+/// character, so frames and commands can be mixed; bytes outside a frame are left to the caller.
+class FrameLink {
+ public:
+
+  /// @brief Enum of frame types.
+  enum class FrameType : uint8_t {
+    kPoint = 'P', ///< A PVT trajectory point (host to device).
+    kStart = 'S', ///< The PVT stream started with an empty buffer; sets the host credits (device to host).
+    kCredit = 'C', ///< PVT credits returned for consumed or rejected points (device to host).
+    kKeyframe = 'K', ///< A keyframe of the stored track (host to device).
+    kTrack = 'T', ///< The no. of keyframes in the stored track; written after the keyframes (host to device).
+    kHeartbeat = 'H', ///< Starts/ends host control, with the heartbeat timeout (host to device).
+    kClock = 'W', ///< Sets the wall-clock time of the week (host to device).
+    kScheduleEntry = 'E', ///< An entry of the stored operating schedule (host to device).
+    kSchedule = 'O', ///< The no. of entries in the stored schedule; written after the entries (host to device).
+    kProfilePart = 'F', ///< A part of a stored profile (host to device).
+    kProfile = 'U', ///< Stores (or erases) the profile in a slot; written after its parts (host to device).
+    kSelectProfile = 'J', ///< Switches to the profile in a slot (host to device).
+    kConfigurationChunk = 'B', ///< A chunk of a configuration blob (host to device, or device to host when exported).
+    kConfiguration = 'Y', ///< Commits the uploaded configuration blob (host to device), or describes the exported one (device to host).
+    kExportConfiguration = 'X', ///< Requests a chunk of the configuration blob, or its blob frame (host to device).
+    kAcknowledge = 'A', ///< The frame (of the type in the payload) was applied (device to host).
+    kNegativeAcknowledge = 'N', ///< The frame (of the type in the payload) was rejected (device to host).
+  };
+
+  /// @brief Enum of parse results.
+  enum class ParseResult : uint8_t {
+    kNotFrame = 0, ///< The byte is outside a frame (e.g., a serial command).
+    kInProgress, ///< The byte is part of a frame that is not yet complete.
+    kFrame, ///< The byte completed a valid frame.
+    kError, ///< The byte completed a frame with a bad CRC or size; the type may be corrupted too.
+  };
+
+  static const uint8_t kFrameStart_ = 0xA5; ///< First byte of every frame.
+  static const uint8_t kMaxSizeOfPayload_ = 16; ///< Max payload size (bytes).
+
+  /// @brief Construct a Frame Link object.
+  FrameLink();
+
+  /// @brief Destroy the Frame Link object.
+  ~FrameLink();
+
+  /// @brief Parse a received byte.
+  /// @param byte The received byte.
+  /// @return The parse result.
+  ParseResult Parse(uint8_t byte);
+
+  /// @brief Discard a partly received frame if no byte has been received for longer than the inter-byte timeout.
+  /// @details Call when no received byte is waiting, so the gap is not one of bytes waiting to be parsed.
+  /// @return kError if a frame was discarded after its type was received, otherwise kNotFrame.
+  ParseResult CheckTimeout();
+
+  /// @brief Get the type of the last frame.
+  /// @return The frame type.
+  FrameType type() const;
+
+  /// @brief Get the payload of the last frame.
+  /// @return The payload.
+  const uint8_t* payload() const;
+
+  /// @brief Get the payload size of the last frame.
+  /// @return The payload size (bytes).
+  uint8_t payload_size() const;
+
+  /// @brief Send a frame.
+  /// @param type The frame type.
+  /// @param payload The payload.
+  /// @param size The payload size (bytes).
+  static void Send(FrameType type, const uint8_t* payload, uint8_t size);
+
+  /// @brief Send an acknowledgement, or a negative acknowledgement, of a frame.
+  /// @param type The type of the frame acknowledged.
+  /// @param applied Whether the frame was applied.
+  static void Acknowledge(FrameType type, bool applied);
+
+  /// @brief Read a little-endian 16-bit value.
+  /// @param bytes The bytes.
+  /// @return The value.
+  static uint16_t ReadUint16(const uint8_t* bytes);
+
+  /// @brief Read a little-endian 32-bit value.
+  /// @param bytes The bytes.
+  /// @return The value.
+  static uint32_t ReadUint32(const uint8_t* bytes);
+
+  /// @brief Write a little-endian 16-bit value.
+  /// @param value The value.
+  /// @param bytes The bytes.
+  static void WriteUint16(uint16_t value, uint8_t* bytes);
+
+ private:
+
+  /// @brief Enum of frame parser states.
+  enum class ParseState : uint8_t {
+    kIdle = 0, ///< Waiting for a frame start byte.
+    kType, ///< Waiting for the frame type.
+    kSize, ///< Waiting for the payload size.
+    kPayload, ///< Receiving the payload.
+    kCrc, ///< Waiting for the CRC.
+  };
+
+  /// @brief Update a CRC-8 (polynomial 0x07) with a byte.
+  /// @param crc The CRC so far.
+  /// @param byte The byte.
+  /// @return The updated CRC.
+  static uint8_t UpdateCrc(uint8_t crc, uint8_t byte);
+
+  static constexpr uint8_t kInterByteTimeout_ = 5; ///< Gap (ms) after which a partly received frame is discarded (about 5 character times at 9600 baud).
+
+  ParseState parse_state_ = ParseState::kIdle; ///< The frame parser state.
+  uint32_t last_byte_time_ms_ = 0; ///< Time (ms) the last byte was parsed.
+  FrameType type_ = FrameType::kPoint; ///< The frame type.
+  uint8_t payload_[kMaxSizeOfPayload_]; ///< The payload.
+  uint8_t payload_size_ = 0; ///< The payload size (bytes).
+  uint8_t received_size_ = 0; ///< No. of payload bytes received.
+  uint8_t crc_ = 0; ///< CRC of the frame being received.
+};
+
+} // namespace mtspin
+
+#endif // FRAME_LINK_H_
\ No newline at end of file
@@ -0,0 +1,151 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file gear_input.cpp
+/// @brief Class to count an external step/direction input in hardware, for electronic gearing.
+
+#include "gear_input.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+
+#if !defined(__AVR__)
+#error "MTSPIN_ELECTRONIC_GEARING requires an AVR target (Timer1 is used as the pulse counter)."
+#endif
+
+#if defined(MTSPIN_PROFILING)
+#error "MTSPIN_ELECTRONIC_GEARING and MTSPIN_PROFILING both use Timer1; define only one."
+#endif
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace {
+
+volatile uint8_t* dir_input_register = nullptr; ///< Input register of the direction pin.
+uint8_t dir_bit_mask = 0; ///< Bit mask of the direction pin.
+bool positive_dir_pin_high = true; ///< Whether the direction pin is high for motion in the positive direction.
+volatile bool dir_positive = true; ///< Whether the direction (since the last direction edge) is positive.
+volatile uint16_t edge_count = 0; ///< Timer1 count at the last direction edge, or the last sample since.
+volatile int32_t edge_pulses = 0; ///< Signed pulses counted between direction edges since the last sample.
+
+/// @brief Read the direction pin.
+/// @return True if the direction is positive.
+inline bool ReadDirection() {
+  return ((*dir_input_register & dir_bit_mask) != 0) == positive_dir_pin_high;
+}
+
+} // namespace
+
+// Only the PCINT2 vector is claimed; the profiler uses PCINT0 (but cannot be compiled in with gearing anyway).
+static_assert(mtspin::Configuration::kGearInputDirPin_ >= 2 && mtspin::Configuration::kGearInputDirPin_ <= 7
+              && mtspin::Configuration::kGearInputDirPin_ != 5,
+              "MTSPIN_ELECTRONIC_GEARING requires the direction pin (kGearInputDirPin_) on port D (pins 2 to 7, other than the T1 input, pin 5; PCINT2).");
+
+/// @brief Pin change interrupt service routine; at each edge of the direction pin, signs the pulses counted since the
+/// last edge by the direction they were counted in, so pulses on either side of a reversal are signed correctly.
+ISR(PCINT2_vect) {
+  uint16_t count = TCNT1;
+  uint16_t pulses = count - edge_count;
+  edge_count = count;
+  edge_pulses += dir_positive ? static_cast<int32_t>(pulses) : -static_cast<int32_t>(pulses);
+  dir_positive = ReadDirection();
+}
+
+#endif // MTSPIN_ELECTRONIC_GEARING
+
+namespace mtspin {
+
+GearInput::GearInput() {}
+
+GearInput::~GearInput() {}
+
+void GearInput::Begin(uint8_t dir_pin, uint8_t positive_dir_pin_state, uint16_t ratio_numerator,
+                      uint16_t ratio_denominator) {
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+  pinMode(dir_pin, INPUT);
+  ratio_numerator_ = ratio_numerator;
+  ratio_denominator_ = ratio_denominator;
+
+  // Run Timer1 in normal mode, clocked on the rising edge of the external input (T1).
+  uint8_t sreg = SREG;
+  cli();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS12) | _BV(CS11) | _BV(CS10);
+  TCNT1 = 0;
+  TIMSK1 = 0;
+
+  // Count the pulses between direction edges with a pin change interrupt on the direction pin.
+  dir_input_register = portInputRegister(digitalPinToPort(dir_pin));
+  dir_bit_mask = digitalPinToBitMask(dir_pin);
+  positive_dir_pin_high = (positive_dir_pin_state == HIGH);
+  dir_positive = ReadDirection();
+  edge_count = 0;
+  edge_pulses = 0;
+  *digitalPinToPCMSK(dir_pin) |= _BV(digitalPinToPCMSKbit(dir_pin));
+  PCICR |= _BV(digitalPinToPCICRbit(dir_pin));
+  SREG = sreg;
+  Restart();
+#else
+  (void)dir_pin;
+  (void)positive_dir_pin_state;
+  (void)ratio_numerator;
+  (void)ratio_denominator;
+#endif
+}
+
+void GearInput::Restart() {
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+  TakePulses();
+  remainder_ = 0;
+  position_ = 0;
+  velocity_ = 0.0F;
+#endif
+}
+
+void GearInput::Sample(float elapsed_s, int32_t& position, float& velocity) {
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+  // Convert the pulses to microsteps, carrying the fraction of a microstep to the next sample. Up to 65535 pulses
+  // times a 16-bit numerator can exceed 32 bits, but a 64-bit division is slow on AVR, so it is only used for a total
+  // that does not fit in 32 bits (e.g., many pulses, after the loop was blocked).
+  int64_t total = static_cast<int64_t>(TakePulses()) * ratio_numerator_ + remainder_;
+  int32_t microsteps = (total >= INT32_MIN && total <= INT32_MAX)
+                       ? static_cast<int32_t>(total) / ratio_denominator_
+                       : static_cast<int32_t>(total / ratio_denominator_);
+  remainder_ = static_cast<int32_t>(total - (static_cast<int64_t>(microsteps) * ratio_denominator_));
+  position_ += microsteps;
+
+  // A sample holds only a few pulses, so the velocity is smoothed; the follower corrects the lag from the position.
+  if (elapsed_s > 0.0F) velocity_ += ((microsteps / elapsed_s) - velocity_) * kVelocitySmoothing_;
+  position = position_;
+  velocity = velocity_;
+#else
+  (void)elapsed_s;
+  position = 0;
+  velocity = 0.0F;
+#endif
+}
+
+int32_t GearInput::TakePulses() {
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+  // Add the pulses since the last direction edge (in the current direction) to those between the edges.
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  uint16_t pulses = count - edge_count;
+  int32_t signed_pulses = edge_pulses + (dir_positive ? static_cast<int32_t>(pulses) : -static_cast<int32_t>(pulses));
+  edge_count = count;
+  edge_pulses = 0;
+  SREG = sreg;
+  return signed_pulses;
+#else
+  return 0;
+#endif
+}
+
+} // namespace mtspin
\ No newline at end of file
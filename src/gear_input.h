@@ -0,0 +1,70 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file gear_input.h
+/// @brief Class to count an external step/direction input in hardware, for electronic gearing.
+
+#ifndef GEAR_INPUT_H_
+#define GEAR_INPUT_H_
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+namespace mtspin {
+
+/// @brief The Gear Input class.
+/// Step pulses from another controller are counted by Timer1, clocked from its external input (T1; pin 5 on the
+/// Uno), so no CPU time is spent per pulse. A pin change interrupt (PCINT2) on the direction input snapshots the count
+/// at each direction edge, so the pulses on either side of a reversal are signed by the direction they were counted in.
+/// The count is taken once per control period. The pulses are converted to microsteps at a rational gear ratio, in
+/// exact integer arithmetic (carrying the remainder), so the follower never drifts from the master. All methods
+/// compile to no-ops, and no state is allocated, unless MTSPIN_ELECTRONIC_GEARING is defined (see configuration.h).
+class GearInput {
+ public:
+
+  /// @brief Construct a Gear Input object.
+  GearInput();
+
+  /// @brief Destroy the Gear Input object.
+  ~GearInput();
+
+  /// @brief Start the pulse counter (Timer1).
+  /// @param dir_pin Input pin for the master direction signal.
+  /// @param positive_dir_pin_state Direction pin state for motion in the positive direction.
+  /// @param ratio_numerator The gear ratio (microsteps per input pulse) numerator.
+  /// @param ratio_denominator The gear ratio (microsteps per input pulse) denominator.
+  void Begin(uint8_t dir_pin, uint8_t positive_dir_pin_state, uint16_t ratio_numerator,
+             uint16_t ratio_denominator); ///< This must be called only once.
+
+  /// @brief Restart from the current master position, at rest; pulses counted since the last sample are discarded.
+  void Restart();
+
+  /// @brief Take the pulses counted since the last sample, and sample the geared position and velocity.
+  /// @param elapsed_s The time (s) since the last sample.
+  /// @param position The geared position (microsteps), relative to the last restart.
+  /// @param velocity The geared velocity (microsteps per second), smoothed over a few samples.
+  void Sample(float elapsed_s, int32_t& position, float& velocity);
+
+ private:
+
+  static constexpr float kVelocitySmoothing_ = 0.125F; ///< Fraction of each velocity sample blended into the smoothed velocity.
+
+  /// @brief Take the signed no. of pulses counted since the last call.
+  /// @return The no. of pulses; negative in the negative direction.
+  int32_t TakePulses();
+
+#if defined(MTSPIN_ELECTRONIC_GEARING)
+  int32_t ratio_numerator_ = 1; ///< The gear ratio numerator.
+  int32_t ratio_denominator_ = 1; ///< The gear ratio denominator.
+  int32_t remainder_ = 0; ///< Remainder of the pulse to microstep conversions (units of 1 / denominator).
+  int32_t position_ = 0; ///< Geared position (microsteps) since the last restart.
+  float velocity_ = 0.0F; ///< Smoothed geared velocity (microsteps per second).
+#endif
+};
+
+} // namespace mtspin
+
+#endif // GEAR_INPUT_H_
\ No newline at end of file
@@ -0,0 +1,122 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file input_shaper.cpp
+/// @brief Class to shape the commanded velocity so that motion does not excite a resonance (e.g., display wobble).
+
+#include "input_shaper.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+namespace mtspin {
+
+InputShaper::InputShaper() {
+  Reset();
+}
+
+InputShaper::~InputShaper() {}
+
+void InputShaper::Configure(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio,
+                            float control_period_s) {
+  no_of_impulses_ = 0;
+#if defined(MTSPIN_INPUT_SHAPING)
+  if (type == Configuration::InputShaperType::kNone || frequency_Hz <= 0.0F || damping_ratio < 0.0F
+      || damping_ratio >= 1.0F) {
+    Reset();
+    return;
+  }
+
+  // Find the damped period, and the ratio of successive impulse amplitudes.
+  float damped_factor = sqrt(1.0F - (damping_ratio * damping_ratio));
+  float damped_period_s = 1.0F / (frequency_Hz * damped_factor);
+  float k = exp(-damping_ratio * PI / damped_factor);
+
+  // Impulses are half a damped period apart, with amplitudes normalised to sum to one.
+  if (type == Configuration::InputShaperType::kZeroVibration) {
+    no_of_impulses_ = 2;
+    amplitudes_[0] = 1.0F / (1.0F + k);
+    amplitudes_[1] = k / (1.0F + k);
+  }
+  else {
+    no_of_impulses_ = 3;
+    float sum = (1.0F + k) * (1.0F + k);
+    amplitudes_[0] = 1.0F / sum;
+    amplitudes_[1] = 2.0F * k / sum;
+    amplitudes_[2] = k * k / sum;
+  }
+
+  // Sample the history often enough to resolve the impulse delays, but rarely enough for the longest delay to fit.
+  float longest_delay_periods = (no_of_impulses_ - 1) * 0.5F * damped_period_s / control_period_s;
+  decimation_ = static_cast<uint8_t>(ceil(longest_delay_periods / (kSizeOfHistory_ - 1)));
+  if (decimation_ == 0) decimation_ = 1;
+  float half_period_samples = 0.5F * damped_period_s / (control_period_s * decimation_);
+  for (uint8_t i = 0; i < no_of_impulses_; i++) {
+    delays_[i] = static_cast<uint8_t>(round(i * half_period_samples));
+    if (delays_[i] > kSizeOfHistory_ - 1) delays_[i] = kSizeOfHistory_ - 1;
+  }
+
+  Reset();
+#else
+  (void)type;
+  (void)frequency_Hz;
+  (void)damping_ratio;
+  (void)control_period_s;
+#endif
+}
+
+float InputShaper::Shape(float velocity) {
+  if (no_of_impulses_ == 0) return velocity;
+#if defined(MTSPIN_INPUT_SHAPING)
+  // Hold the shaped velocity between history samples.
+  if (decimation_count_ > 0) {
+    decimation_count_--;
+    return shaped_velocity_;
+  }
+  decimation_count_ = decimation_ - 1;
+
+  // Add the sample, and convolve the history with the impulse sequence.
+  head_ = (head_ + 1) % kSizeOfHistory_;
+  history_[head_] = static_cast<int16_t>(round(velocity));
+  uint8_t longest_delay = delays_[no_of_impulses_ - 1];
+  if (history_[head_] != 0) quiet_samples_ = 0;
+  else if (quiet_samples_ <= longest_delay) quiet_samples_++;
+
+  shaped_velocity_ = 0.0F;
+  for (uint8_t i = 0; i < no_of_impulses_; i++) {
+    uint8_t index = (head_ + kSizeOfHistory_ - delays_[i]) % kSizeOfHistory_;
+    shaped_velocity_ += amplitudes_[i] * history_[index];
+  }
+
+  return shaped_velocity_;
+#else
+  return velocity;
+#endif
+}
+
+void InputShaper::Reset() {
+#if defined(MTSPIN_INPUT_SHAPING)
+  for (uint8_t i = 0; i < kSizeOfHistory_; i++) history_[i] = 0;
+  head_ = 0;
+  decimation_count_ = 0;
+  quiet_samples_ = kSizeOfHistory_;
+  shaped_velocity_ = 0.0F;
+#endif
+}
+
+bool InputShaper::enabled() const {
+  return no_of_impulses_ > 0;
+}
+
+bool InputShaper::settled() const {
+#if defined(MTSPIN_INPUT_SHAPING)
+  return no_of_impulses_ == 0 || quiet_samples_ > delays_[no_of_impulses_ - 1];
+#else
+  return true;
+#endif
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,76 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file input_shaper.h
+/// @brief Class to shape the commanded velocity so that motion does not excite a resonance (e.g., display wobble).
+
+#ifndef INPUT_SHAPER_H_
+#define INPUT_SHAPER_H_
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+namespace mtspin {
+
+/// @brief The Input Shaper class.
+/// The commanded velocity is convolved with a zero vibration (ZV) or zero vibration derivative (ZVD) impulse
+/// sequence, tuned to the resonance frequency and damping ratio of the load. The impulses sum to one, so the
+/// distance moved is unchanged; motion is delayed by half (ZV) or one (ZVD) damped period of the resonance. Shaping
+/// is disabled, and the history is not allocated, unless MTSPIN_INPUT_SHAPING is defined (see configuration.h).
+class InputShaper {
+ public:
+
+  /// @brief Construct an Input Shaper object.
+  InputShaper();
+
+  /// @brief Destroy the Input Shaper object.
+  ~InputShaper();
+
+  /// @brief Configure the input shaper.
+  /// @param type The input shaper type.
+  /// @param frequency_Hz The resonance frequency (Hz).
+  /// @param damping_ratio The resonance damping ratio (0 to less than 1).
+  /// @param control_period_s The period (s) at which Shape() is called.
+  void Configure(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio,
+                 float control_period_s);
+
+  /// @brief Shape the commanded velocity.
+  /// @param velocity The commanded velocity.
+  /// @return The shaped velocity.
+  float Shape(float velocity); ///< This must be called once per control period.
+
+  /// @brief Clear the velocity history (e.g., when motion is halted).
+  void Reset();
+
+  /// @brief Check whether shaping is enabled.
+  /// @return True if enabled.
+  bool enabled() const;
+
+  /// @brief Check whether the shaped velocity has settled, i.e., the whole history is zero.
+  /// @return True if settled.
+  bool settled() const;
+
+ private:
+
+  static const uint8_t kSizeOfHistory_ = 64; ///< No. of commanded velocity samples kept.
+  static const uint8_t kMaxNoOfImpulses_ = 3; ///< Max no. of impulses in the impulse sequence.
+
+  uint8_t no_of_impulses_ = 0; ///< No. of impulses in the impulse sequence; 0 if shaping is disabled.
+#if defined(MTSPIN_INPUT_SHAPING)
+  float amplitudes_[kMaxNoOfImpulses_]; ///< Impulse amplitudes.
+  uint8_t delays_[kMaxNoOfImpulses_]; ///< Impulse delays (history samples).
+  uint8_t decimation_ = 1; ///< No. of control periods per history sample, so the longest delay fits the history.
+  uint8_t decimation_count_ = 0; ///< No. of control periods until the next history sample.
+  int16_t history_[kSizeOfHistory_]; ///< Commanded velocity samples (rounded); a ring buffer.
+  uint8_t head_ = 0; ///< Index of the newest history sample.
+  uint8_t quiet_samples_ = 0; ///< No. of consecutive zero history samples (up to the longest delay + 1).
+  float shaped_velocity_ = 0.0F; ///< The shaped velocity.
+#endif
+};
+
+} // namespace mtspin
+
+#endif // INPUT_SHAPER_H_
\ No newline at end of file
@@ -0,0 +1,93 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file keyframe_track.cpp
+/// @brief Class to play back a looping keyframe animation track stored in EEPROM.
+
+#include "keyframe_track.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "frame_link.h"
+#include "trajectory.h"
+
+namespace mtspin {
+
+KeyframeTrack::KeyframeTrack(uint16_t eeprom_address) : eeprom_address_(eeprom_address) {}
+
+KeyframeTrack::~KeyframeTrack() {}
+
+bool KeyframeTrack::Load() {
+  uint8_t size = EEPROM.read(eeprom_address_ + 1);
+  bool stored = (EEPROM.read(eeprom_address_) == kVersion_) && size > 0 && size <= kMaxSizeOfTrack_;
+  size_ = stored ? size : 0;
+  next_index_ = 0;
+  Restart();
+  return stored;
+}
+
+bool KeyframeTrack::StoreKeyframe(const uint8_t* payload, uint8_t size) {
+  if (size != kSizeOfKeyframePayload_ || payload[0] >= kMaxSizeOfTrack_) return false;
+
+  // Empty the track first, so a partly stored track is never played.
+  EEPROM.update(eeprom_address_ + 1, 0);
+  size_ = 0;
+  Keyframe keyframe;
+  keyframe.angle_decidegrees = static_cast<int16_t>(FrameLink::ReadUint16(&payload[1]));
+  keyframe.time_ms = FrameLink::ReadUint16(&payload[3]);
+  EEPROM.put(eeprom_address_ + 2 + (4 * payload[0]), keyframe);
+  return true;
+}
+
+bool KeyframeTrack::StoreLength(const uint8_t* payload, uint8_t size) {
+  if (size != 1 || payload[0] > kMaxSizeOfTrack_) return false;
+  EEPROM.update(eeprom_address_, kVersion_);
+  EEPROM.update(eeprom_address_ + 1, payload[0]);
+  Load();
+  return true;
+}
+
+bool KeyframeTrack::Valid(uint16_t eeprom_address) {
+  return EEPROM.read(eeprom_address) != kVersion_ || EEPROM.read(eeprom_address + 1) <= kMaxSizeOfTrack_;
+}
+
+void KeyframeTrack::set_eeprom_address(uint16_t eeprom_address) {
+  eeprom_address_ = eeprom_address;
+}
+
+uint8_t KeyframeTrack::size() const {
+  return size_;
+}
+
+bool KeyframeTrack::StartNextSegment() {
+  if (size_ == 0) return false;
+
+  // Catmull-Rom velocity at the keyframe: the slope between its neighbours.
+  uint8_t previous_index = (next_index_ > 0) ? (next_index_ - 1) : (size_ - 1);
+  uint8_t following_index = NextIndex(next_index_);
+  Keyframe previous = ReadKeyframe(previous_index);
+  Keyframe keyframe = ReadKeyframe(next_index_);
+  Keyframe following = ReadKeyframe(following_index);
+  float span_ms = static_cast<float>(keyframe.time_ms) + following.time_ms;
+  float velocity = (span_ms > 0.0F)
+                   ? ((following.angle_decidegrees - previous.angle_decidegrees) * 10000.0F / span_ms)
+                   : 0.0F;
+  StartSegment(keyframe.angle_decidegrees * 10.0F, velocity, keyframe.time_ms);
+  next_index_ = following_index;
+  return true;
+}
+
+KeyframeTrack::Keyframe KeyframeTrack::ReadKeyframe(uint8_t index) const {
+  Keyframe keyframe;
+  EEPROM.get(eeprom_address_ + 2 + (4 * index), keyframe);
+  return keyframe;
+}
+
+uint8_t KeyframeTrack::NextIndex(uint8_t index) const {
+  return (index + 1 < size_) ? (index + 1) : 0;
+}
+
+} // namespace mtspin
\ No newline at end of file
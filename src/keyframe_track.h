@@ -0,0 +1,104 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file keyframe_track.h
+/// @brief Class to play back a looping keyframe animation track stored in EEPROM.
+
+#ifndef KEYFRAME_TRACK_H_
+#define KEYFRAME_TRACK_H_
+
+#include <Arduino.h>
+
+#include "trajectory.h"
+
+namespace mtspin {
+
+/// @brief The Keyframe Track class.
+/// A track is a loop of angle keyframes, each with the time (ms) from the previous keyframe; the first keyframe's
+/// time is from the last (closing the loop), and is also the time from the start position to the first keyframe.
+/// The track is interpolated by a Catmull-Rom spline: cubic Hermite segments, with the velocity at each keyframe set
+/// by its neighbours, so the motion is smooth through every keyframe. Each segment's coefficients are computed from
+/// a few EEPROM reads when it starts, so playback costs the same per control period however long the track is.
+///
+/// EEPROM layout: a version byte (kVersion_; anything else means no track), the no. of keyframes, then the
+/// keyframes (int16 angle (decidegrees), uint16 time (ms); 4 bytes each). Keyframe frame payload: uint8 index,
+/// int16 angle and uint16 time; track frame payload: uint8 no. of keyframes (0 to erase).
+class KeyframeTrack : public Trajectory {
+ public:
+
+  static const uint8_t kMaxSizeOfTrack_ = 32; ///< Max no. of keyframes.
+  static const uint16_t kSizeOfEeprom_ = 2 + (4 * kMaxSizeOfTrack_); ///< EEPROM used by the track (bytes).
+
+  /// @brief Construct a Keyframe Track object.
+  /// @param eeprom_address The EEPROM address of the track.
+  explicit KeyframeTrack(uint16_t eeprom_address);
+
+  /// @brief Destroy the Keyframe Track object.
+  ~KeyframeTrack();
+
+  /// @brief Load the track, and restart it from the start position (the origin), at rest.
+  /// @return True if a track is stored.
+  bool Load();
+
+  /// @brief Store a keyframe; the stored track is emptied until its length is stored (see StoreLength()).
+  /// @param payload The keyframe frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored; false if the payload is invalid.
+  bool StoreKeyframe(const uint8_t* payload, uint8_t size);
+
+  /// @brief Store the no. of keyframes, completing (or erasing) the track, and load it.
+  /// @param payload The track frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored; false if the payload is invalid.
+  bool StoreLength(const uint8_t* payload, uint8_t size);
+
+  /// @brief Check that the track stored at an address, if any, is valid (e.g., before it is put in use).
+  /// @param eeprom_address The EEPROM address of the track.
+  /// @return True if valid, or no track is stored.
+  static bool Valid(uint16_t eeprom_address);
+
+  /// @brief Set the EEPROM address of the track (e.g., when the configuration bank changes); then call Load().
+  /// @param eeprom_address The EEPROM address of the track.
+  void set_eeprom_address(uint16_t eeprom_address);
+
+  /// @brief Get the no. of keyframes.
+  /// @return The no. of keyframes; 0 if no track is stored.
+  uint8_t size() const;
+
+ protected:
+
+  /// @brief Start the segment to the next keyframe.
+  /// @return True if a segment was started; false if no track is stored.
+  bool StartNextSegment() override;
+
+ private:
+
+  /// @brief A keyframe, as stored in EEPROM.
+  struct Keyframe {
+    int16_t angle_decidegrees; ///< Angle (tenths of a degree).
+    uint16_t time_ms; ///< Time (ms) from the previous keyframe.
+  };
+
+  static const uint8_t kVersion_ = 1; ///< Version of the stored track layout.
+  static const uint8_t kSizeOfKeyframePayload_ = 5; ///< Payload size (bytes) of a keyframe frame.
+
+  /// @brief Read a keyframe from EEPROM.
+  /// @param index The keyframe index.
+  /// @return The keyframe.
+  Keyframe ReadKeyframe(uint8_t index) const;
+
+  /// @brief Get the index of the keyframe after an index, wrapping around to the first.
+  /// @param index The keyframe index.
+  /// @return The next keyframe index.
+  uint8_t NextIndex(uint8_t index) const;
+
+  uint16_t eeprom_address_; ///< The EEPROM address of the track.
+  uint8_t size_ = 0; ///< No. of keyframes; 0 if no track is stored.
+  uint8_t next_index_ = 0; ///< Index of the keyframe at the end of the next segment.
+};
+
+} // namespace mtspin
+
+#endif // KEYFRAME_TRACK_H_
\ No newline at end of file
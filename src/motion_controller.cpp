@@ -0,0 +1,382 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_controller.cpp
+/// @brief Class to move the stepper motor by generating step/direction pulses from the motion planner.
+
+#include "motion_controller.h"
+
+#include <Arduino.h>
+#include <stepper_driver.h>
+
+#include "gear_input.h"
+#include "input_shaper.h"
+#include "motion_planner.h"
+#include "spi_step_generator.h"
+#include "step_generator.h"
+#include "trajectory.h"
+
+namespace mtspin {
+
+MotionController::MotionController(uint8_t pul_pin, uint8_t dir_pin, uint16_t microstep_mode,
+                                   float full_step_angle_degrees, uint16_t gear_ratio_numerator,
+                                   uint16_t gear_ratio_denominator)
+    : pul_pin_(pul_pin),
+      dir_pin_(dir_pin),
+      microsteps_per_cycle_(4 * microstep_mode) {
+  // Microsteps per centidegree = (full steps per revolution x microstep mode x gear ratio) / centidegrees per
+  // revolution, reduced by the greatest common divisor.
+  uint32_t full_steps_per_revolution = static_cast<uint32_t>(round(360.0F / full_step_angle_degrees));
+  angle_numerator_ = full_steps_per_revolution * microstep_mode * gear_ratio_numerator;
+  angle_denominator_ = static_cast<uint32_t>(kCentidegreesPerRevolution_) * gear_ratio_denominator;
+  uint32_t divisor = angle_numerator_;
+  uint32_t remainder = angle_denominator_;
+  while (remainder != 0) {
+    uint32_t next_remainder = divisor % remainder;
+    divisor = remainder;
+    remainder = next_remainder;
+  }
+
+  angle_numerator_ /= divisor;
+  angle_denominator_ /= divisor;
+  microsteps_per_revolution_ = static_cast<float>(angle_numerator_) * kCentidegreesPerRevolution_ / angle_denominator_;
+  microsteps_per_centidegree_ = static_cast<float>(angle_numerator_) / angle_denominator_;
+  planner_.set_control_period_us(control_period_us_);
+}
+
+MotionController::~MotionController() {}
+
+void MotionController::Begin(uint32_t step_tick_rate_Hz, uint8_t max_step_smoothing_level) {
+  step_generator_.Begin(pul_pin_, step_tick_rate_Hz, max_step_smoothing_level, double_edge_stepping_);
+}
+
+MotionPlanner::MotionStatus MotionController::MoveByAngle(float angle_degrees,
+                                                           mt::StepperDriver::MotionType motion_type) {
+  trajectory_ = nullptr;
+  gear_input_ = nullptr;
+  if (motion_type == mt::StepperDriver::MotionType::kStopAndReset) {
+    // Stop, at the deceleration, and end the move.
+    planner_.Stop(MotionPlanner::StopMode::kDecelerate);
+  }
+  else if (!move_in_progress_ && planner_.status() == MotionPlanner::MotionStatus::kIdle) {
+    // Start a new move, carrying the fraction of a microstep to the next move.
+    int64_t total = static_cast<int64_t>(lround(angle_degrees * 100.0F)) * angle_numerator_ + angle_remainder_;
+    int32_t microsteps = static_cast<int32_t>(total / static_cast<int64_t>(angle_denominator_));
+    angle_remainder_ = total - (static_cast<int64_t>(microsteps) * angle_denominator_);
+    planner_.MoveBy(microsteps);
+    move_in_progress_ = true;
+    jogging_ = false;
+  }
+
+  MotionPlanner::MotionStatus status = Run();
+  if (status == MotionPlanner::MotionStatus::kIdle) move_in_progress_ = false;
+  return status;
+}
+
+MotionPlanner::MotionStatus MotionController::MoveByJogging(mt::StepperDriver::MotionDirection direction) {
+  planner_.Jog(static_cast<int8_t>(direction));
+  move_in_progress_ = false;
+  jogging_ = true;
+  trajectory_ = nullptr;
+  gear_input_ = nullptr;
+  return Run();
+}
+
+MotionPlanner::MotionStatus MotionController::MoveByTrajectory(Trajectory& trajectory) {
+  if (trajectory_ != &trajectory) {
+    follow_origin_ = planner_.position();
+    trajectory_ = &trajectory;
+    gear_input_ = nullptr;
+  }
+
+  move_in_progress_ = false;
+  jogging_ = false;
+  return Run();
+}
+
+MotionPlanner::MotionStatus MotionController::MoveByGearing(GearInput& gear_input) {
+  if (gear_input_ != &gear_input) {
+    follow_origin_ = planner_.position();
+    gear_input.Restart();
+    gear_input_ = &gear_input;
+    trajectory_ = nullptr;
+  }
+
+  move_in_progress_ = false;
+  jogging_ = false;
+  return Run();
+}
+
+void MotionController::Stop(MotionPlanner::StopMode stop_mode) {
+  planner_.Stop(stop_mode);
+  jogging_ = false;
+  trajectory_ = nullptr;
+  gear_input_ = nullptr;
+}
+
+MotionPlanner::MotionStatus MotionController::Run() {
+  uint32_t now_us = micros();
+
+  // Update the plan once per control period (skipping missed periods, rather than catching up in a burst).
+  uint32_t elapsed_us = now_us - last_update_us_;
+  if (elapsed_us >= control_period_us_) {
+    last_update_us_ = (elapsed_us >= 2U * control_period_us_) ? now_us : (last_update_us_ + control_period_us_);
+    if (trajectory_ != nullptr) {
+      // Sample the trajectory at the time since the last update (up to two control periods, so it never jumps).
+      uint32_t sample_us = (elapsed_us < 2U * control_period_us_) ? elapsed_us : (2U * control_period_us_);
+      float position = 0.0F;
+      float velocity = 0.0F;
+      trajectory_->Sample(sample_us / 1000000.0F, position, velocity);
+      planner_.Follow(follow_origin_ + CentidegreesToMicrosteps(position), velocity * microsteps_per_centidegree_);
+    }
+    else if (gear_input_ != nullptr) {
+      // Sample the gear input; the pulses are counted in hardware, so none are lost if an update is late.
+      int32_t position = 0;
+      float velocity = 0.0F;
+      gear_input_->Sample(elapsed_us / 1000000.0F, position, velocity);
+      planner_.Follow(follow_origin_ + position, velocity);
+    }
+
+    planner_.Update();
+#if defined(MTSPIN_SPI_STEPPING)
+    UpdateSpiStepGenerator();
+#endif
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+    UpdateStepGenerator();
+#endif
+  }
+
+#if defined(MTSPIN_SPI_STEPPING)
+  // Record the steps shifted out by SPI; while it is active, the other step engine is idle.
+  RecordSteps(spi_step_generator_.TakeSteps());
+  if (spi_step_generator_.active()) {
+    last_step_us_ = now_us;
+    return planner_.status();
+  }
+#endif
+
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  // Record the steps taken by the step generator, and limit it to the remaining steps of a move.
+  RecordSteps(step_generator_.TakeSteps(planner_.steps_to_target()));
+#else
+  // Take a step if one is due.
+  uint32_t step_interval_us = CorrectStepInterval(planner_.step_interval_us());
+  if (step_interval_us == 0) {
+    last_step_us_ = now_us; // Stationary; the first step is due one interval after motion starts.
+  }
+  else {
+    elapsed_us = now_us - last_step_us_;
+    if (elapsed_us >= step_interval_us) {
+      Step(planner_.step_direction());
+      last_step_us_ = (elapsed_us >= 2 * step_interval_us) ? now_us : (last_step_us_ + step_interval_us);
+    }
+  }
+#endif
+
+  return planner_.status();
+}
+
+void MotionController::StepForTiming() {
+  // An idle planner returns from Update() at once, so a jog is planned to time the full update.
+  planner_.Jog(1);
+  planner_.Update();
+  volatile uint32_t step_interval_us = CorrectStepInterval(planner_.step_interval_us());
+  (void)step_interval_us;
+  Pulse();
+  UpdateDither();
+}
+
+void MotionController::EndTiming() {
+  planner_.Halt();
+}
+
+void MotionController::SetSpeed(float speed_RPM) {
+  planner_.SetSpeed(speed_RPM * microsteps_per_revolution_ / 60.0F);
+}
+
+void MotionController::SetAccelerations(float acceleration, float deceleration, float quick_stop_deceleration) {
+  planner_.SetAccelerations(acceleration, deceleration, quick_stop_deceleration);
+}
+
+void MotionController::SetAccelerationCurve(const float* speeds_RPM, const float* scales, uint8_t size) {
+  float speeds[MotionPlanner::kMaxSizeOfAccelerationCurve_];
+  if (size > MotionPlanner::kMaxSizeOfAccelerationCurve_) size = MotionPlanner::kMaxSizeOfAccelerationCurve_;
+  for (uint8_t i = 0; i < size; i++) {
+    speeds[i] = speeds_RPM[i] * microsteps_per_revolution_ / 60.0F;
+  }
+
+  planner_.SetAccelerationCurve(speeds, scales, size);
+}
+
+void MotionController::SetInputShaper(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio) {
+  planner_.SetInputShaper(type, frequency_Hz, damping_ratio);
+}
+
+void MotionController::SetCoggingCorrections(const int8_t* corrections, uint8_t size) {
+  cogging_corrections_ = corrections;
+  microsteps_per_correction_ = (size > 0) ? (microsteps_per_cycle_ / size) : 0;
+  next_correction_ = (size > 0) ? cogging_corrections_[cycle_position_ / microsteps_per_correction_] : 0;
+}
+
+void MotionController::set_step_dither(uint8_t dither) {
+  dither_ = dither;
+  if (dither_ == 0) next_dither_ = 0;
+}
+
+void MotionController::set_control_period_us(uint16_t control_period_us) {
+  control_period_us_ = control_period_us;
+  planner_.set_control_period_us(control_period_us_);
+}
+
+void MotionController::set_pul_delay_us(float pul_delay_us) {
+  pul_delay_us_ = static_cast<uint16_t>(ceil(pul_delay_us));
+}
+
+void MotionController::set_double_edge_stepping(bool double_edge_stepping) {
+  double_edge_stepping_ = double_edge_stepping;
+}
+
+void MotionController::set_spi_stepping_min_step_rate(float step_rate) {
+  spi_stepping_min_step_rate_ = step_rate;
+}
+
+void MotionController::set_dir_delay_us(float dir_delay_us) {
+  dir_delay_us_ = static_cast<uint16_t>(ceil(dir_delay_us));
+}
+
+void MotionController::set_positive_dir_pin_state(uint8_t positive_dir_pin_state) {
+  positive_dir_pin_state_ = positive_dir_pin_state;
+  dir_pin_direction_ = 0; // Force the DIR pin to be set on the next step.
+}
+
+MotionPlanner::MotionStatus MotionController::status() const {
+  return planner_.status();
+}
+
+int32_t MotionController::position() const {
+  return planner_.position();
+}
+
+float MotionController::microsteps_per_revolution() const {
+  return microsteps_per_revolution_;
+}
+
+void MotionController::Step(int8_t direction) {
+  if (direction != dir_pin_direction_) {
+    // Set the direction, and wait for the driver to register it before stepping.
+    WriteDirPin(direction);
+    delayMicroseconds(dir_delay_us_);
+    dir_pin_direction_ = direction;
+  }
+
+  Pulse();
+  RecordStep(direction);
+  UpdateDither();
+}
+
+void MotionController::RecordStep(int8_t direction) {
+  planner_.RecordStep(direction);
+
+  // Track the position within the electrical cycle, and look up the correction for the next step.
+  if (direction > 0) cycle_position_ = (cycle_position_ + 1 < microsteps_per_cycle_) ? (cycle_position_ + 1) : 0;
+  else cycle_position_ = (cycle_position_ > 0) ? (cycle_position_ - 1) : (microsteps_per_cycle_ - 1);
+  if (microsteps_per_correction_ > 0) {
+    next_correction_ = cogging_corrections_[cycle_position_ / microsteps_per_correction_];
+  }
+}
+
+void MotionController::RecordSteps(uint16_t steps) {
+  for (; steps > 0; steps--) RecordStep(dir_pin_direction_);
+}
+
+void MotionController::UpdateStepGenerator() {
+  int8_t direction = planner_.step_direction();
+  if (direction != 0 && direction != dir_pin_direction_) {
+    // Set the direction, holding the step generator for a tick so the driver registers it before the next step.
+    // Steps not yet recorded were taken in the previous direction.
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t steps = step_generator_.TakeSteps(0);
+    step_generator_.Hold();
+    WriteDirPin(direction);
+    SREG = sreg;
+    RecordSteps(steps);
+    dir_pin_direction_ = direction;
+  }
+
+  // The anti-cogging correction is applied to the step rate; it changes slowly at the low speeds where it matters.
+  // The dither is applied to the step rate (per update, rather than per step), so its mean is exact.
+  UpdateDither();
+  float step_rate = fabs(planner_.velocity()) * (1024 - next_dither_) / (1024 + next_correction_);
+  step_generator_.SetStepRate(spi_step_generator_.active() ? 0.0F : step_rate);
+}
+
+void MotionController::UpdateSpiStepGenerator() {
+  float speed = fabs(planner_.velocity());
+  bool use_spi = jogging_ && planner_.status() == MotionPlanner::MotionStatus::kConstantSpeed
+                 && speed >= spi_stepping_min_step_rate_ && planner_.step_direction() == dir_pin_direction_;
+  if (use_spi && !spi_step_generator_.active()) {
+    spi_step_generator_.Start(speed);
+  }
+  else if (!use_spi && spi_step_generator_.active()) {
+    // Hand back to the other step engine, e.g., to ramp the speed.
+    spi_step_generator_.Stop(pul_pin_);
+    RecordSteps(spi_step_generator_.TakeSteps());
+  }
+}
+
+void MotionController::WriteDirPin(int8_t direction) const {
+  uint8_t negative_dir_pin_state = (positive_dir_pin_state_ == HIGH) ? LOW : HIGH;
+  digitalWrite(dir_pin_, (direction > 0) ? positive_dir_pin_state_ : negative_dir_pin_state);
+}
+
+void MotionController::Pulse() {
+  if (double_edge_stepping_) {
+    pul_pin_state_ = (pul_pin_state_ == HIGH) ? LOW : HIGH;
+    digitalWrite(pul_pin_, pul_pin_state_);
+    return;
+  }
+
+  digitalWrite(pul_pin_, HIGH);
+  delayMicroseconds(pul_delay_us_);
+  digitalWrite(pul_pin_, LOW);
+}
+
+void MotionController::UpdateDither() {
+  if (dither_ == 0) return;
+  if (negate_next_dither_) {
+    next_dither_ = -next_dither_;
+  }
+  else {
+    // Galois LFSR step (taps 16, 14, 13, 11); the low byte is a uniform signed value, scaled to the max dither.
+    dither_lfsr_ = (dither_lfsr_ >> 1) ^ (-(dither_lfsr_ & 1U) & 0xB400U);
+    next_dither_ = (static_cast<int8_t>(dither_lfsr_ & 0xFF) * static_cast<int16_t>(dither_)) / 128;
+  }
+
+  negate_next_dither_ = !negate_next_dither_;
+}
+
+int32_t MotionController::CentidegreesToMicrosteps(float centidegrees) const {
+  // Whole centidegrees are converted exactly at the reduced ratio, like MoveByAngle(); only the remainder and the
+  // fraction of a centidegree (together, less than one microstep plus the ratio) are in floating point.
+  float whole = floor(centidegrees);
+  int64_t total = static_cast<int64_t>(whole) * angle_numerator_;
+  int32_t microsteps = static_cast<int32_t>(total / static_cast<int64_t>(angle_denominator_));
+  float remainder = static_cast<float>(total - (static_cast<int64_t>(microsteps) * angle_denominator_))
+                    + ((centidegrees - whole) * angle_numerator_);
+  return microsteps + static_cast<int32_t>(lround(remainder / angle_denominator_));
+}
+
+uint32_t MotionController::CorrectStepInterval(uint32_t step_interval_us) const {
+  int16_t correction = next_correction_ + next_dither_;
+  // The correction is within +/-512 parts per 1024 (a cogging correction plus a dither), so the product fits in 32 bits
+  // for intervals up to about 4 s. Longer intervals (near zero velocity, e.g., when following) are not corrected.
+  if (correction == 0 || step_interval_us == 0 || step_interval_us > (INT32_MAX / 512)) return step_interval_us;
+  // Parts per 1024, as an arithmetic shift (rounding down), which is cheaper than a signed division.
+  int32_t correction_us = (static_cast<int32_t>(step_interval_us) * correction) >> 10;
+  return step_interval_us + correction_us;
+}
+
+} // namespace mtspin
\ No newline at end of file
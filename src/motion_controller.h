@@ -0,0 +1,252 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_controller.h
+/// @brief Class to move the stepper motor by generating step/direction pulses from the motion planner.
+
+#ifndef MOTION_CONTROLLER_H_
+#define MOTION_CONTROLLER_H_
+
+#include <Arduino.h>
+#include <stepper_driver.h>
+
+#include "configuration.h"
+#include "gear_input.h"
+#include "input_shaper.h"
+#include "motion_planner.h"
+#include "spi_step_generator.h"
+#include "step_generator.h"
+#include "trajectory.h"
+
+namespace mtspin {
+
+/// @brief The Motion Controller class.
+/// The stepper driver library still controls the driver ENA pin (power state); this class drives the PUL and DIR
+/// pins, so that the velocity profile (acceleration, deceleration and quick stops) is planned by MotionPlanner.
+/// Steps are taken by polling the step interval in Run(), or by StepGenerator from a fixed-rate timer interrupt if
+/// MTSPIN_FIXED_RATE_STEPPING is defined (see configuration.h). If MTSPIN_SPI_STEPPING is defined, steps are shifted
+/// out by SpiStepGenerator instead while jogging at a constant high speed.
+class MotionController {
+ public:
+
+  /// @brief Construct a Motion Controller object.
+  /// @param pul_pin Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
+  /// @param dir_pin Output pin for the stepper driver DIR/CW (direction) interface.
+  /// @param microstep_mode The stepper driver microstep mode.
+  /// @param full_step_angle_degrees The stepper motor full step angle (degrees); a whole no. per revolution.
+  /// @param gear_ratio_numerator The system/stepper motor gear ratio numerator.
+  /// @param gear_ratio_denominator The system/stepper motor gear ratio denominator.
+  MotionController(uint8_t pul_pin, uint8_t dir_pin, uint16_t microstep_mode, float full_step_angle_degrees,
+                   uint16_t gear_ratio_numerator, uint16_t gear_ratio_denominator);
+
+  /// @brief Destroy the Motion Controller object.
+  ~MotionController();
+
+  /// @brief Start the step generator (fixed-rate stepping only).
+  /// @param step_tick_rate_Hz The step generator base tick rate (Hz).
+  /// @param max_step_smoothing_level The max step smoothing level (tick rate doublings at low step rates).
+  void Begin(uint32_t step_tick_rate_Hz, uint8_t max_step_smoothing_level); ///< This must be called only once.
+
+  /// @brief Move by an angle, relative to the position at the start of the move.
+  /// Angles are converted to microsteps in exact integer arithmetic, carrying the remainder (the fraction of a
+  /// microstep) to the next move, so a sequence of moves never drifts from the sum of their angles.
+  /// @param angle_degrees The angle and direction (sign) of the move (degrees, resolved to 0.01 degrees).
+  /// @param motion_type The motion type; kStopAndReset stops (at the deceleration) and ends the move.
+  /// @return The motion status; kIdle once the move is complete (or stopped).
+  MotionPlanner::MotionStatus MoveByAngle(float angle_degrees, mt::StepperDriver::MotionType motion_type); ///< This must be called repeatedly.
+
+  /// @brief Move indefinitely at the speed.
+  /// @param direction The direction of motion.
+  /// @return The motion status.
+  MotionPlanner::MotionStatus MoveByJogging(mt::StepperDriver::MotionDirection direction); ///< This must be called repeatedly.
+
+  /// @brief Follow a trajectory (e.g., a PVT stream or a keyframe track), from the position at the first call.
+  /// The trajectory is sampled each control period and followed with bounded acceleration/deceleration.
+  /// @param trajectory The trajectory.
+  /// @return The motion status.
+  MotionPlanner::MotionStatus MoveByTrajectory(Trajectory& trajectory); ///< This must be called repeatedly.
+
+  /// @brief Follow an external step/direction input (electronic gearing), from the positions at the first call.
+  /// The input is sampled each control period and followed with bounded acceleration/deceleration.
+  /// @param gear_input The gear input.
+  /// @return The motion status.
+  MotionPlanner::MotionStatus MoveByGearing(GearInput& gear_input); ///< This must be called repeatedly.
+
+  /// @brief Stop the motion; Run() must be called until the motion status is kIdle.
+  /// @param stop_mode The stop mode.
+  void Stop(MotionPlanner::StopMode stop_mode);
+
+  /// @brief Update the motion plan each control period, and take a step when one is due.
+  /// @return The motion status.
+  MotionPlanner::MotionStatus Run(); ///< This must be called repeatedly.
+
+  /// @brief Plan a jog, and output its step pulse (with the anti-cogging and dither corrections) immediately,
+  /// regardless of timing; the position is unchanged. Only for timing the worst-case control loop while the driver is
+  /// disabled; call EndTiming() afterwards.
+  void StepForTiming();
+
+  /// @brief Stop the jog planned by StepForTiming() immediately, returning the planner to idle.
+  void EndTiming();
+
+  /// @brief Set the speed.
+  /// @param speed_RPM The speed (RPM).
+  void SetSpeed(float speed_RPM);
+
+  /// @brief Set the accelerations.
+  /// @param acceleration The acceleration (microsteps per second-squared).
+  /// @param deceleration The deceleration (microsteps per second-squared).
+  /// @param quick_stop_deceleration The quick stop deceleration (microsteps per second-squared).
+  void SetAccelerations(float acceleration, float deceleration, float quick_stop_deceleration);
+
+  /// @brief Set the acceleration curve, which scales the acceleration with speed.
+  /// @param speeds_RPM The speeds of the curve points, in ascending order (RPM).
+  /// @param scales The acceleration scale factors at the curve points.
+  /// @param size The no. of curve points.
+  void SetAccelerationCurve(const float* speeds_RPM, const float* scales, uint8_t size);
+
+  /// @brief Set the input shaper.
+  /// @param type The input shaper type.
+  /// @param frequency_Hz The resonance frequency (Hz).
+  /// @param damping_ratio The resonance damping ratio.
+  void SetInputShaper(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio);
+
+  /// @brief Set the anti-cogging table, which corrects the step intervals to flatten the speed ripple within each
+  /// electrical cycle (4 full steps), e.g., from motor detent torque. The table is indexed from the driver home
+  /// position (the position at startup).
+  /// @param corrections The step interval corrections (parts per 1024); the table must outlive this object.
+  /// @param size The no. of corrections, which must divide the no. of microsteps per electrical cycle; 0 to disable.
+  void SetCoggingCorrections(const int8_t* corrections, uint8_t size);
+
+  /// @brief Set the step interval dither, which spreads the motor tone (spread-spectrum). Random dithers are applied
+  /// in antithetic (+/-) pairs, so the mean step interval, and the average speed, are exact.
+  /// @param dither The max dither (parts per 1024 of the step interval); 0 to disable.
+  void set_step_dither(uint8_t dither);
+
+  /// @brief Set the control period (the period of motion plan updates).
+  /// @param control_period_us The control period (us).
+  void set_control_period_us(uint16_t control_period_us);
+
+  /// @brief Set the minimum delay for the PUL pin.
+  /// @param pul_delay_us The delay (us).
+  void set_pul_delay_us(float pul_delay_us);
+
+  /// @brief Set whether the driver steps on both PUL edges; PUL is then toggled once per step, with no pulse delay.
+  /// This must be set before Begin().
+  /// @param double_edge_stepping Whether to use double-edge stepping.
+  void set_double_edge_stepping(bool double_edge_stepping);
+
+  /// @brief Set the min step rate for SPI stepping (SPI stepping only).
+  /// @param step_rate The step rate (microsteps per second).
+  void set_spi_stepping_min_step_rate(float step_rate);
+
+  /// @brief Set the minimum delay for the DIR pin.
+  /// @param dir_delay_us The delay (us).
+  void set_dir_delay_us(float dir_delay_us);
+
+  /// @brief Set the DIR pin state for motion in the positive direction.
+  /// @param positive_dir_pin_state The DIR pin state (HIGH or LOW).
+  void set_positive_dir_pin_state(uint8_t positive_dir_pin_state);
+
+  /// @brief Get the motion status.
+  /// @return The motion status.
+  MotionPlanner::MotionStatus status() const;
+
+  /// @brief Get the position (the no. of microsteps taken from the position at startup).
+  /// @return The position (microsteps).
+  int32_t position() const;
+
+  /// @brief Get the no. of microsteps per revolution of the system (i.e., after the gear ratio).
+  /// @return The no. of microsteps per revolution.
+  float microsteps_per_revolution() const;
+
+ private:
+
+  /// @brief Take a step.
+  /// @param direction The step direction (1 or -1).
+  void Step(int8_t direction);
+
+  /// @brief Record a step that was taken, and look up the anti-cogging correction for the next step.
+  /// @param direction The step direction (1 or -1).
+  void RecordStep(int8_t direction);
+
+  /// @brief Record steps taken by the step generator, in the direction set on the DIR pin.
+  /// @param steps The no. of steps.
+  void RecordSteps(uint16_t steps);
+
+  /// @brief Pass the planned velocity to the step generator, setting the DIR pin first if the direction changed.
+  void UpdateStepGenerator();
+
+  /// @brief Start SPI stepping when jogging at a constant high speed, and stop it otherwise.
+  void UpdateSpiStepGenerator();
+
+  /// @brief Set the DIR pin for a direction.
+  /// @param direction The direction (1 or -1).
+  void WriteDirPin(int8_t direction) const;
+
+  /// @brief Output a pulse on the PUL pin, or toggle it with double-edge stepping.
+  void Pulse();
+
+  /// @brief Find the dither for the next step (or step generator update).
+  void UpdateDither();
+
+  /// @brief Convert a trajectory position to the nearest microstep, exactly for whole centidegrees.
+  /// @param centidegrees The position (centidegrees).
+  /// @return The position (microsteps).
+  int32_t CentidegreesToMicrosteps(float centidegrees) const;
+
+  /// @brief Apply the anti-cogging correction and the dither for the next step to a step interval.
+  /// @param step_interval_us The step interval (us).
+  /// @return The corrected step interval (us).
+  uint32_t CorrectStepInterval(uint32_t step_interval_us) const;
+
+  // Pins and timing.
+  uint8_t pul_pin_; ///< Output pin for the stepper driver PUL interface.
+  uint8_t dir_pin_; ///< Output pin for the stepper driver DIR interface.
+  uint16_t pul_delay_us_ = 1; ///< Minimum delay (us) for the PUL pin.
+  bool double_edge_stepping_ = false; ///< Whether the driver steps on both PUL edges.
+  uint8_t pul_pin_state_ = LOW; ///< PUL pin state (for double-edge stepping).
+  uint16_t dir_delay_us_ = 5; ///< Minimum delay (us) for the DIR pin.
+  uint8_t positive_dir_pin_state_ = HIGH; ///< DIR pin state for motion in the positive direction.
+  int8_t dir_pin_direction_ = 0; ///< Direction currently set on the DIR pin (0 if not yet set).
+
+  // Units.
+  static const uint16_t kCentidegreesPerRevolution_ = 36000; ///< No. of hundredths of a degree per revolution.
+  uint32_t angle_numerator_; ///< Microsteps per centidegree of the system, as a reduced fraction; the numerator.
+  uint32_t angle_denominator_; ///< Microsteps per centidegree of the system, as a reduced fraction; the denominator.
+  int64_t angle_remainder_ = 0; ///< Remainder of the angle to microstep conversions (units of 1 / denominator).
+  float microsteps_per_revolution_; ///< No. of microsteps per revolution of the system (i.e., after the gear ratio).
+  float microsteps_per_centidegree_; ///< No. of microsteps per centidegree of the system (for trajectory velocities).
+
+  // Anti-cogging.
+  uint16_t microsteps_per_cycle_; ///< No. of microsteps per electrical cycle (4 full steps).
+  uint16_t cycle_position_ = 0; ///< Position within the electrical cycle (microsteps).
+  const int8_t* cogging_corrections_ = nullptr; ///< Step interval corrections (parts per 1024).
+  uint16_t microsteps_per_correction_ = 0; ///< No. of microsteps covered by each correction; 0 if disabled.
+  int8_t next_correction_ = 0; ///< Correction for the next step.
+
+  // Spread-spectrum dither.
+  uint8_t dither_ = 0; ///< Max dither (parts per 1024 of the step interval).
+  uint16_t dither_lfsr_ = 0xACE1; ///< Pseudo-random dither generator (16-bit Galois LFSR); never 0.
+  int16_t next_dither_ = 0; ///< Dither for the next step (parts per 1024).
+  bool negate_next_dither_ = false; ///< Whether the next dither is the negation of the last (the second of a pair).
+
+  // Motion planning.
+  MotionPlanner planner_; ///< The motion planner.
+  StepGenerator step_generator_; ///< The fixed-rate step generator (if MTSPIN_FIXED_RATE_STEPPING is defined).
+  SpiStepGenerator spi_step_generator_; ///< The SPI step generator (if MTSPIN_SPI_STEPPING is defined).
+  float spi_stepping_min_step_rate_ = 0.0F; ///< Min step rate for SPI stepping (microsteps per second).
+  bool jogging_ = false; ///< Whether the motion was started by MoveByJogging().
+  Trajectory* trajectory_ = nullptr; ///< The trajectory being followed (by MoveByTrajectory()); nullptr if none.
+  GearInput* gear_input_ = nullptr; ///< The gear input being followed (by MoveByGearing()); nullptr if none.
+  int32_t follow_origin_ = 0; ///< Position (microsteps) at the start of the trajectory or gearing.
+  uint16_t control_period_us_ = 1000; ///< The control period (us).
+  uint32_t last_update_us_ = 0; ///< Time of the last plan update (us).
+  uint32_t last_step_us_ = 0; ///< Time of the last step (us).
+  bool move_in_progress_ = false; ///< Whether a move started by MoveByAngle() is in progress.
+};
+
+} // namespace mtspin
+
+#endif // MOTION_CONTROLLER_H_
\ No newline at end of file
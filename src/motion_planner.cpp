@@ -0,0 +1,265 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_planner.cpp
+/// @brief Class to plan the velocity profile of the stepper motor, one control period at a time.
+
+#include "motion_planner.h"
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+MotionPlanner::MotionPlanner() {}
+
+MotionPlanner::~MotionPlanner() {}
+
+void MotionPlanner::set_control_period_us(uint16_t control_period_us) {
+  control_period_s_ = control_period_us / 1000000.0F;
+  SetAccelerations(acceleration_, deceleration_, quick_stop_deceleration_);
+  SetInputShaper(shaper_type_, shaper_frequency_Hz_, shaper_damping_ratio_);
+}
+
+void MotionPlanner::SetSpeed(float speed) {
+  speed_ = speed;
+}
+
+void MotionPlanner::SetAccelerations(float acceleration, float deceleration, float quick_stop_deceleration) {
+  acceleration_ = acceleration;
+  deceleration_ = deceleration;
+  quick_stop_deceleration_ = quick_stop_deceleration;
+  acceleration_step_ = acceleration_ * control_period_s_;
+  deceleration_step_ = deceleration_ * control_period_s_;
+  quick_stop_step_ = quick_stop_deceleration_ * control_period_s_;
+  half_inverse_deceleration_ = (deceleration_ > 0.0F) ? (0.5F / deceleration_) : 0.0F;
+  min_speed_ = sqrt(deceleration_); // Speed reached half a microstep before the end of a decelerating move.
+}
+
+void MotionPlanner::SetAccelerationCurve(const float* speeds, const float* scales, uint8_t size) {
+  curve_size_ = (size < kMaxSizeOfAccelerationCurve_) ? size : kMaxSizeOfAccelerationCurve_;
+  for (uint8_t i = 0; i < curve_size_; i++) {
+    curve_speeds_[i] = speeds[i];
+    curve_scales_[i] = scales[i];
+    curve_slopes_[i] = 0.0F; // Constant beyond the last point.
+    if (i > 0) curve_slopes_[i - 1] = (scales[i] - scales[i - 1]) / (speeds[i] - speeds[i - 1]);
+  }
+}
+
+void MotionPlanner::SetInputShaper(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio) {
+  shaper_type_ = type;
+  shaper_frequency_Hz_ = frequency_Hz;
+  shaper_damping_ratio_ = damping_ratio;
+  shaper_.Configure(shaper_type_, shaper_frequency_Hz_, shaper_damping_ratio_, control_period_s_);
+}
+
+void MotionPlanner::MoveBy(int32_t microsteps) {
+  target_position_ = position_ + microsteps;
+  planned_position_ = position_;
+  mode_ = (microsteps == 0) ? Mode::kIdle : Mode::kMove;
+}
+
+void MotionPlanner::Jog(int8_t direction) {
+  jog_direction_ = direction;
+  mode_ = Mode::kJog;
+}
+
+void MotionPlanner::Follow(int32_t position, float velocity) {
+  follow_position_ = position;
+  follow_velocity_ = velocity;
+  if (mode_ == Mode::kFollow) return;
+  // Shaping would delay the response to the position error, so it is bypassed.
+  if (shaping()) BypassShaper();
+  mode_ = Mode::kFollow;
+}
+
+void MotionPlanner::Stop(StopMode stop_mode) {
+  if (mode_ == Mode::kIdle) return;
+  // A quick stop is never downgraded to a normal stop.
+  if (mode_ != Mode::kStop || stop_mode == StopMode::kQuickStop) stop_mode_ = stop_mode;
+  mode_ = Mode::kStop;
+
+  // Quick stops are not delayed by shaping; slow down from the shaped velocity.
+  if (stop_mode_ == StopMode::kQuickStop && shaping()) BypassShaper();
+}
+
+MotionPlanner::MotionStatus MotionPlanner::Update() {
+  // Find the target velocity.
+  float target_velocity = 0.0F;
+  float slow_down_step = deceleration_step_;
+  switch (mode_) {
+    case Mode::kIdle: {
+      return status_;
+    }
+    case Mode::kMove: {
+      // Plan from the commanded position when shaping, as the position lags behind it.
+      float remaining_microsteps = shaping() ? (target_position_ - planned_position_)
+                                             : static_cast<float>(target_position_ - position_);
+      if (fabs(remaining_microsteps) < 0.5F) {
+        Settle(true);
+        return status_;
+      }
+
+      target_velocity = (remaining_microsteps > 0) ? speed_ : -speed_;
+      if (velocity_ * remaining_microsteps > 0.0F) {
+        // Moving towards the target; decelerate if it is within the stopping distance, one control period ahead.
+        float speed = fabs(velocity_);
+        float stopping_distance = (speed * speed * half_inverse_deceleration_) + (speed * control_period_s_);
+        if (fabs(remaining_microsteps) <= stopping_distance) {
+          target_velocity = (remaining_microsteps > 0) ? min_speed_ : -min_speed_;
+        }
+      }
+
+      break;
+    }
+    case Mode::kJog: {
+      target_velocity = jog_direction_ * speed_;
+      break;
+    }
+    case Mode::kFollow: {
+      // The setpoint is in whole microsteps, so the motor does not hunt around a fractional setpoint, and the error
+      // is exact at any position. Large errors are corrected no faster than the speed that can still stop in the
+      // error, so they do not overshoot (e.g., when the trajectory starts moving, or stops short).
+      float position_error = static_cast<float>(follow_position_ - position_);
+      float error_distance = fabs(position_error);
+      float correction = (error_distance < 0.5F) ? 0.0F : (position_error * kFollowGain_per_s_);
+      if (error_distance * kFollowGain_per_s_ * kFollowGain_per_s_ * half_inverse_deceleration_ > 1.0F) {
+        float max_correction = sqrt(error_distance / half_inverse_deceleration_);
+        correction = (position_error > 0.0F) ? max_correction : -max_correction;
+      }
+
+      target_velocity = follow_velocity_ + correction;
+      break;
+    }
+    case Mode::kStop: {
+      if (stop_mode_ == StopMode::kQuickStop) slow_down_step = quick_stop_step_;
+      break;
+    }
+    case Mode::kSettle: {
+      // Wait for the shaped velocity to settle, then take any remaining microsteps (of a move) at the min speed.
+      SetVelocity(0.0F);
+      if (shaper_.settled()) {
+        int32_t remaining_microsteps = settle_to_target_ ? (target_position_ - position_) : 0;
+        if (remaining_microsteps == 0) Halt();
+        else SetOutputVelocity((remaining_microsteps > 0) ? min_speed_ : -min_speed_);
+      }
+
+      return status_;
+    }
+  }
+
+  // Move the velocity towards the target; speed up at the acceleration, and slow down (towards a lower speed in
+  // the same direction, or towards zero) at the deceleration. Reversals always pass through zero.
+  float speed = fabs(velocity_);
+  float target_speed = fabs(target_velocity);
+  bool same_direction = (velocity_ == 0.0F) || ((velocity_ > 0.0F) == (target_velocity > 0.0F));
+  float direction = (velocity_ != 0.0F) ? ((velocity_ > 0.0F) ? 1.0F : -1.0F)
+                                        : ((target_velocity >= 0.0F) ? 1.0F : -1.0F);
+  if (same_direction && target_speed > speed) {
+    speed = min(speed + (acceleration_step_ * AccelerationScale(speed)), target_speed);
+    status_ = MotionStatus::kAccelerate;
+  }
+  else if (same_direction && target_speed == speed) {
+    status_ = (speed > 0.0F) ? MotionStatus::kConstantSpeed : MotionStatus::kIdle;
+  }
+  else {
+    float floor_speed = same_direction ? target_speed : 0.0F;
+    speed = max(speed - slow_down_step, floor_speed);
+    status_ = MotionStatus::kDecelerate;
+  }
+
+  SetVelocity(direction * speed);
+  if (mode_ == Mode::kStop && speed == 0.0F) Settle(false);
+  return status_;
+}
+
+void MotionPlanner::RecordStep(int8_t direction) {
+  position_ += direction;
+  if (moving_to_target() && position_ == target_position_) Halt();
+}
+
+MotionPlanner::MotionStatus MotionPlanner::status() const {
+  return status_;
+}
+
+uint32_t MotionPlanner::step_interval_us() const {
+  return step_interval_us_;
+}
+
+int8_t MotionPlanner::step_direction() const {
+  return (output_velocity_ > 0.0F) ? 1 : ((output_velocity_ < 0.0F) ? -1 : 0);
+}
+
+float MotionPlanner::velocity() const {
+  return output_velocity_;
+}
+
+uint32_t MotionPlanner::steps_to_target() const {
+  return moving_to_target() ? static_cast<uint32_t>(labs(target_position_ - position_)) : UINT32_MAX;
+}
+
+int32_t MotionPlanner::position() const {
+  return position_;
+}
+
+void MotionPlanner::SetVelocity(float velocity) {
+  velocity_ = velocity;
+  planned_position_ += velocity_ * control_period_s_;
+  SetOutputVelocity(shaping() ? shaper_.Shape(velocity_) : velocity_);
+}
+
+void MotionPlanner::SetOutputVelocity(float velocity) {
+  output_velocity_ = velocity;
+  float speed = fabs(output_velocity_);
+  // Followed velocities can pass arbitrarily close to zero, so the interval is limited to the range of its type.
+  float step_interval_us = (speed > 0.0F) ? (1000000.0F / speed) : 0.0F;
+  step_interval_us_ = (step_interval_us < 4294967040.0F) ? static_cast<uint32_t>(step_interval_us) : 0xFFFFFFFFUL;
+  if (step_interval_us_ == 0 && speed > 0.0F) step_interval_us_ = 1;
+}
+
+bool MotionPlanner::moving_to_target() const {
+  return (mode_ == Mode::kMove) || (mode_ == Mode::kSettle && settle_to_target_);
+}
+
+bool MotionPlanner::shaping() const {
+  return shaper_.enabled() && !bypass_shaper_;
+}
+
+void MotionPlanner::BypassShaper() {
+  velocity_ = output_velocity_;
+  shaper_.Reset();
+  bypass_shaper_ = true;
+}
+
+void MotionPlanner::Settle(bool to_target) {
+  if (!shaping()) {
+    Halt();
+    return;
+  }
+
+  velocity_ = 0.0F;
+  settle_to_target_ = to_target;
+  mode_ = Mode::kSettle;
+  status_ = MotionStatus::kDecelerate;
+}
+
+void MotionPlanner::Halt() {
+  velocity_ = 0.0F;
+  SetOutputVelocity(0.0F);
+  shaper_.Reset();
+  bypass_shaper_ = false;
+  planned_position_ = position_;
+  mode_ = Mode::kIdle;
+  status_ = MotionStatus::kIdle;
+}
+
+float MotionPlanner::AccelerationScale(float speed) const {
+  if (curve_size_ == 0) return 1.0F;
+  if (speed <= curve_speeds_[0]) return curve_scales_[0];
+  uint8_t i = curve_size_ - 1;
+  while (speed < curve_speeds_[i]) i--; // Find the curve segment.
+  return curve_scales_[i] + (curve_slopes_[i] * (speed - curve_speeds_[i]));
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,218 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_planner.h
+/// @brief Class to plan the velocity profile of the stepper motor, one control period at a time.
+
+#ifndef MOTION_PLANNER_H_
+#define MOTION_PLANNER_H_
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "input_shaper.h"
+
+namespace mtspin {
+
+/// @brief The Motion Planner class.
+/// The velocity is updated once per control period, speeding up at the acceleration and slowing down at the
+/// deceleration (or the quick stop deceleration), and is converted to a step interval for the step generator.
+/// The commanded velocity may be passed through an input shaper; moves are then planned from the commanded
+/// position, and the remaining microsteps are taken once the shaped velocity has settled.
+/// Distances are in microsteps, and time in seconds.
+class MotionPlanner {
+ public:
+
+  /// @brief Enum of motion status.
+  enum class MotionStatus {
+    kIdle = 0,
+    kAccelerate,
+    kConstantSpeed,
+    kDecelerate,
+  };
+
+  /// @brief Enum of stop modes.
+  enum class StopMode {
+    kDecelerate = 0, ///< Stop at the deceleration.
+    kQuickStop, ///< Stop at the quick stop deceleration (e.g., emergency stop or fault).
+  };
+
+  static const uint8_t kMaxSizeOfAccelerationCurve_ = 8; ///< Max no. of points in the acceleration curve.
+
+  /// @brief Construct a Motion Planner object.
+  MotionPlanner();
+
+  /// @brief Destroy the Motion Planner object.
+  ~MotionPlanner();
+
+  /// @brief Set the control period (the period at which Update() is called).
+  /// @param control_period_us The control period (us).
+  void set_control_period_us(uint16_t control_period_us);
+
+  /// @brief Set the speed; changes take effect with bounded acceleration/deceleration, without restarting motion.
+  /// @param speed The speed (microsteps per second).
+  void SetSpeed(float speed);
+
+  /// @brief Set the accelerations.
+  /// @param acceleration The acceleration, used when speeding up (microsteps per second-squared).
+  /// @param deceleration The deceleration, used when slowing down, reversing and stopping (microsteps per second-squared).
+  /// @param quick_stop_deceleration The deceleration for quick stops (microsteps per second-squared).
+  void SetAccelerations(float acceleration, float deceleration, float quick_stop_deceleration);
+
+  /// @brief Set the acceleration curve, which scales the acceleration with speed (e.g., to follow the motor torque
+  /// curve); the scale factor is linearly interpolated between the curve points.
+  /// @param speeds The speeds of the curve points, in ascending order (microsteps per second).
+  /// @param scales The acceleration scale factors at the curve points.
+  /// @param size The no. of curve points (up to kMaxSizeOfAccelerationCurve_); 0 for a constant acceleration.
+  void SetAccelerationCurve(const float* speeds, const float* scales, uint8_t size);
+
+  /// @brief Set the input shaper, which shapes the commanded velocity to avoid exciting a resonance of the load.
+  /// Quick stops are not shaped.
+  /// @param type The input shaper type.
+  /// @param frequency_Hz The resonance frequency (Hz).
+  /// @param damping_ratio The resonance damping ratio.
+  void SetInputShaper(Configuration::InputShaperType type, float frequency_Hz, float damping_ratio);
+
+  /// @brief Start a move relative to the current position.
+  /// @param microsteps The distance and direction (sign) of the move (microsteps).
+  void MoveBy(int32_t microsteps);
+
+  /// @brief Move indefinitely at the speed; reverses (via the deceleration) if moving in the opposite direction.
+  /// @param direction The direction of motion (1 or -1).
+  void Jog(int8_t direction);
+
+  /// @brief Follow a moving setpoint (e.g., a sampled trajectory); the velocity is the setpoint velocity plus a
+  /// correction proportional to the position error, reached at the acceleration/deceleration. Not shaped.
+  /// @param position The setpoint position (microsteps).
+  /// @param velocity The setpoint velocity (microsteps per second).
+  void Follow(int32_t position, float velocity); ///< This must be called once per control period, before Update().
+
+  /// @brief Stop the motion.
+  /// @param stop_mode The stop mode.
+  void Stop(StopMode stop_mode);
+
+  /// @brief Stop immediately, without decelerating (e.g., at the end of a move).
+  void Halt();
+
+  /// @brief Update the velocity for the next control period.
+  /// @return The motion status.
+  MotionStatus Update(); ///< This must be called once per control period.
+
+  /// @brief Record that a step was taken.
+  /// @param direction The direction of the step (1 or -1).
+  void RecordStep(int8_t direction);
+
+  /// @brief Get the motion status.
+  /// @return The motion status.
+  MotionStatus status() const;
+
+  /// @brief Get the interval between steps at the current velocity.
+  /// @return The step interval (us), or 0 if no step should be taken.
+  uint32_t step_interval_us() const;
+
+  /// @brief Get the direction of the next step.
+  /// @return The step direction (1 or -1), or 0 if stationary.
+  int8_t step_direction() const;
+
+  /// @brief Get the output (shaped) velocity.
+  /// @return The velocity (microsteps per second).
+  float velocity() const;
+
+  /// @brief Get the no. of steps to the target of a move, to limit steps taken between control periods.
+  /// @return The no. of steps (microsteps), or UINT32_MAX if not moving to a target.
+  uint32_t steps_to_target() const;
+
+  /// @brief Get the position.
+  /// @return The position (microsteps).
+  int32_t position() const;
+
+ private:
+
+  /// @brief Enum of planning modes.
+  enum class Mode {
+    kIdle = 0,
+    kMove,
+    kJog,
+    kStop,
+    kSettle, ///< Waiting for the shaped velocity to settle after the commanded velocity reached zero.
+    kFollow, ///< Following a moving setpoint.
+  };
+
+  static constexpr float kFollowGain_per_s_ = 20.0F; ///< Velocity correction per microstep of position error, when following.
+
+  /// @brief Set the commanded velocity, and the output (shaped) velocity.
+  /// @param velocity The commanded velocity (microsteps per second).
+  void SetVelocity(float velocity);
+
+  /// @brief Set the output velocity and the matching step interval.
+  /// @param velocity The output velocity (microsteps per second).
+  void SetOutputVelocity(float velocity);
+
+  /// @brief Check whether the motion ends at a target position (i.e., a move).
+  /// @return True if moving to a target.
+  bool moving_to_target() const;
+
+  /// @brief Check whether the commanded velocity is being shaped.
+  /// @return True if shaping.
+  bool shaping() const;
+
+  /// @brief Bypass the input shaper until idle, continuing from the shaped velocity.
+  void BypassShaper();
+
+  /// @brief End the commanded motion; halts, or waits for the shaped velocity to settle if shaping.
+  /// @param to_target Whether to take the remaining microsteps to the target position after settling.
+  void Settle(bool to_target);
+
+  /// @brief Get the acceleration scale factor at a speed, from the acceleration curve.
+  /// @param speed The speed (microsteps per second).
+  /// @return The acceleration scale factor.
+  float AccelerationScale(float speed) const;
+
+  // Planning parameters.
+  float control_period_s_ = 0.001F; ///< The control period (s).
+  float speed_ = 0.0F; ///< The speed (microsteps per second).
+  float acceleration_ = 0.0F; ///< The acceleration (microsteps per second-squared).
+  float deceleration_ = 0.0F; ///< The deceleration (microsteps per second-squared).
+  float quick_stop_deceleration_ = 0.0F; ///< The quick stop deceleration (microsteps per second-squared).
+
+  // Precomputed per control period values.
+  float acceleration_step_ = 0.0F; ///< Velocity change per control period when accelerating.
+  float deceleration_step_ = 0.0F; ///< Velocity change per control period when decelerating.
+  float quick_stop_step_ = 0.0F; ///< Velocity change per control period when quick stopping.
+  float half_inverse_deceleration_ = 0.0F; ///< 1 / (2 x deceleration); to find stopping distances.
+  float min_speed_ = 0.0F; ///< Speed at which the final microsteps of a move are taken (microsteps per second).
+
+  // Acceleration curve.
+  uint8_t curve_size_ = 0; ///< No. of points in the acceleration curve.
+  float curve_speeds_[kMaxSizeOfAccelerationCurve_]; ///< Speeds of the curve points (microsteps per second).
+  float curve_scales_[kMaxSizeOfAccelerationCurve_]; ///< Acceleration scale factors at the curve points.
+  float curve_slopes_[kMaxSizeOfAccelerationCurve_]; ///< Scale factor change per unit speed after each curve point.
+
+  // Input shaping.
+  InputShaper shaper_; ///< The input shaper.
+  Configuration::InputShaperType shaper_type_ = Configuration::InputShaperType::kNone; ///< The input shaper type.
+  float shaper_frequency_Hz_ = 0.0F; ///< The resonance frequency (Hz).
+  float shaper_damping_ratio_ = 0.0F; ///< The resonance damping ratio.
+  bool bypass_shaper_ = false; ///< Whether shaping is bypassed until idle (e.g., during a quick stop).
+  bool settle_to_target_ = false; ///< Whether to take the remaining microsteps to the target after settling.
+
+  // Motion state.
+  Mode mode_ = Mode::kIdle; ///< The planning mode.
+  StopMode stop_mode_ = StopMode::kDecelerate; ///< The stop mode, when stopping.
+  MotionStatus status_ = MotionStatus::kIdle; ///< The motion status.
+  int8_t jog_direction_ = 1; ///< The direction when jogging.
+  int32_t position_ = 0; ///< The position (microsteps).
+  int32_t target_position_ = 0; ///< The target position of a move (microsteps).
+  float planned_position_ = 0.0F; ///< The commanded position (microsteps); leads the position when shaping.
+  int32_t follow_position_ = 0; ///< The setpoint position when following (microsteps).
+  float follow_velocity_ = 0.0F; ///< The setpoint velocity when following (microsteps per second).
+  float velocity_ = 0.0F; ///< The commanded velocity (microsteps per second).
+  float output_velocity_ = 0.0F; ///< The output (shaped) velocity (microsteps per second).
+  uint32_t step_interval_us_ = 0; ///< The step interval at the output velocity (us); 0 if stationary.
+};
+
+} // namespace mtspin
+
+#endif // MOTION_PLANNER_H_
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file profile_slots.cpp
+/// @brief Class to store complete operating profiles (mode, speeds, sweep angles, etc.) in EEPROM slots.
+
+#include "profile_slots.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <stddef.h>
+
+#include "frame_link.h"
+
+namespace mtspin {
+
+ProfileSlots::ProfileSlots(uint16_t eeprom_address) : eeprom_address_(eeprom_address) {}
+
+ProfileSlots::~ProfileSlots() {}
+
+bool ProfileSlots::Load(uint8_t slot, Profile& profile) const {
+  if (slot >= kSizeOfSlots_ || EEPROM.read(SlotAddress(slot)) != kVersion_) return false;
+  EEPROM.get(SlotAddress(slot) + 1, profile);
+  return true;
+}
+
+bool ProfileSlots::StorePart(const uint8_t* payload, uint8_t size) {
+  if (size < 2 || payload[0] >= kSizeOfSlots_) return false;
+  Part part = static_cast<Part>(payload[1]);
+  if (part == Part::kSettings) {
+    if (size != 8) return false;
+  }
+  else if (part > Part::kSweepAngles || size != 2 + (2 * kSizeOfTables_)) {
+    return false;
+  }
+
+  // Empty the slot first, so a partly stored profile is never used.
+  uint16_t address = SlotAddress(payload[0]);
+  EEPROM.update(address, 0);
+  address++;
+  if (part == Part::kSettings) {
+    EEPROM.update(address + offsetof(Profile, mode), payload[2]);
+    EEPROM.update(address + offsetof(Profile, direction), payload[3]);
+    EEPROM.update(address + offsetof(Profile, speed_index), payload[4]);
+    EEPROM.update(address + offsetof(Profile, sweep_angle_index), payload[5]);
+    EEPROM.put(address + offsetof(Profile, acceleration), static_cast<float>(FrameLink::ReadUint16(&payload[6])));
+    return true;
+  }
+
+  // Convert the table to RPM or degrees, so it is used as stored.
+  float scale = 0.01F;
+  if (part == Part::kSpeeds) {
+    address += offsetof(Profile, speeds_RPM);
+  }
+  else if (part == Part::kReturnSpeeds) {
+    address += offsetof(Profile, return_speeds_RPM);
+  }
+  else {
+    address += offsetof(Profile, sweep_angles_degrees);
+    scale = 0.1F;
+  }
+
+  for (uint8_t i = 0; i < kSizeOfTables_; i++) {
+    EEPROM.put(address + (4 * i), FrameLink::ReadUint16(&payload[2 + (2 * i)]) * scale);
+  }
+
+  return true;
+}
+
+bool ProfileSlots::StoreProfile(const uint8_t* payload, uint8_t size) {
+  if (size != 2 || payload[0] >= kSizeOfSlots_ || payload[1] > 1) return false;
+  uint16_t address = SlotAddress(payload[0]);
+  if (payload[1] == 0) {
+    EEPROM.update(address, 0);
+    return true;
+  }
+
+  // Unwritten parts read as NaN (erased EEPROM), and comparisons with NaN are false, so they fail validation.
+  Profile profile;
+  EEPROM.get(address + 1, profile);
+  if (!Valid(profile)) return false;
+  EEPROM.update(address, kVersion_);
+  return true;
+}
+
+bool ProfileSlots::Valid(uint16_t eeprom_address) {
+  for (uint8_t slot = 0; slot < kSizeOfSlots_; slot++) {
+    uint16_t address = eeprom_address + (slot * (1 + sizeof(Profile)));
+    if (EEPROM.read(address) != kVersion_) continue;
+    Profile profile;
+    EEPROM.get(address + 1, profile);
+    if (!Valid(profile)) return false;
+  }
+
+  return true;
+}
+
+void ProfileSlots::set_eeprom_address(uint16_t eeprom_address) {
+  eeprom_address_ = eeprom_address;
+}
+
+uint16_t ProfileSlots::SlotAddress(uint8_t slot) const {
+  return eeprom_address_ + (slot * (1 + sizeof(Profile)));
+}
+
+bool ProfileSlots::Valid(const Profile& profile) {
+  if (profile.mode > Mode::kTrack || (profile.direction != 1 && profile.direction != -1)
+      || profile.speed_index >= kSizeOfTables_ || profile.sweep_angle_index >= kSizeOfTables_
+      || !(profile.acceleration >= 0.0F)) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < kSizeOfTables_; i++) {
+    if (!(profile.speeds_RPM[i] > 0.0F) || !(profile.return_speeds_RPM[i] > 0.0F)
+        || !(profile.sweep_angles_degrees[i] > 0.0F)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,113 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file profile_slots.h
+/// @brief Class to store complete operating profiles (mode, speeds, sweep angles, etc.) in EEPROM slots.
+
+#ifndef PROFILE_SLOTS_H_
+#define PROFILE_SLOTS_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The Profile Slots class.
+/// Each slot holds a complete operating profile, validated and converted to the firmware's units when it is stored,
+/// so switching profiles is only a slot read.
+///
+/// EEPROM layout: for each slot, a version byte (kVersion_; anything else means no profile), then the profile (see
+/// Profile). Profile part frame payload: uint8 slot, uint8 part (see Part), then the part: the settings (uint8 mode,
+/// int8 direction, uint8 speed index, uint8 sweep angle index and uint16 acceleration (microsteps per second-squared;
+/// 0 for the configured or calibrated acceleration)), the speeds or return speeds (uint16 centi-RPM each), or the
+/// sweep angles (uint16 decidegrees each). Profile frame payload: uint8 slot, uint8 1 to store (or 0 to erase).
+class ProfileSlots {
+ public:
+
+  /// @brief Enum of profile control modes.
+  enum class Mode : uint8_t {
+    kContinuous = 0,
+    kOscillate,
+    kTrack, ///< Play back the stored keyframe track.
+  };
+
+  static const uint8_t kSizeOfTables_ = 4; ///< No. of speeds and sweep angles in each profile's lookup tables.
+
+  /// @brief An operating profile.
+  struct Profile {
+    Mode mode; ///< Control mode.
+    int8_t direction; ///< Initial motion direction; 1 (positive) or -1 (negative).
+    uint8_t speed_index; ///< Index of the initial speed.
+    uint8_t sweep_angle_index; ///< Index of the initial sweep angle.
+    float acceleration; ///< Acceleration (microsteps per second-squared); 0 for the configured or calibrated one.
+    float speeds_RPM[kSizeOfTables_]; ///< Lookup table for rotation speeds (RPM).
+    float return_speeds_RPM[kSizeOfTables_]; ///< Lookup table for return (negative sweep) speeds (RPM).
+    float sweep_angles_degrees[kSizeOfTables_]; ///< Lookup table for sweep angles (degrees).
+  };
+
+  static const uint8_t kSizeOfSlots_ = 4; ///< No. of slots; slot 0 is used at startup.
+  static const uint16_t kSizeOfEeprom_ = kSizeOfSlots_ * (1 + sizeof(Profile)); ///< EEPROM used by the slots (bytes).
+
+  /// @brief Construct a Profile Slots object.
+  /// @param eeprom_address The EEPROM address of the first slot.
+  explicit ProfileSlots(uint16_t eeprom_address);
+
+  /// @brief Destroy the Profile Slots object.
+  ~ProfileSlots();
+
+  /// @brief Load the profile in a slot.
+  /// @param slot The slot.
+  /// @param profile The profile; unchanged if no profile is stored in the slot.
+  /// @return True if a profile is stored in the slot.
+  bool Load(uint8_t slot, Profile& profile) const;
+
+  /// @brief Store a part of a profile; its slot is emptied until the profile is stored (see StoreProfile()).
+  /// @param payload The profile part frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored; false if the payload is invalid.
+  bool StorePart(const uint8_t* payload, uint8_t size);
+
+  /// @brief Store (or erase) the profile in a slot, once all its parts are stored.
+  /// @param payload The profile frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored (or erased); false if the payload, or any part of the profile, is invalid or missing.
+  bool StoreProfile(const uint8_t* payload, uint8_t size);
+
+  /// @brief Check that every profile stored in the slots at an address is valid (e.g., before they are put in use).
+  /// @param eeprom_address The EEPROM address of the first slot.
+  /// @return True if valid.
+  static bool Valid(uint16_t eeprom_address);
+
+  /// @brief Set the EEPROM address of the slots (e.g., when the configuration bank changes).
+  /// @param eeprom_address The EEPROM address of the first slot.
+  void set_eeprom_address(uint16_t eeprom_address);
+
+ private:
+
+  /// @brief Enum of profile parts.
+  enum class Part : uint8_t {
+    kSettings = 0, ///< Mode, direction, initial indices and acceleration.
+    kSpeeds, ///< Speeds.
+    kReturnSpeeds, ///< Return speeds.
+    kSweepAngles, ///< Sweep angles.
+  };
+
+  static const uint8_t kVersion_ = 1; ///< Version of the stored profile layout.
+
+  /// @brief Get the EEPROM address of a slot.
+  /// @param slot The slot.
+  /// @return The address of the slot's version byte; the profile follows it.
+  uint16_t SlotAddress(uint8_t slot) const;
+
+  /// @brief Check that a profile is complete and within range.
+  /// @param profile The profile.
+  /// @return True if valid.
+  static bool Valid(const Profile& profile);
+
+  uint16_t eeprom_address_; ///< The EEPROM address of the first slot.
+};
+
+} // namespace mtspin
+
+#endif // PROFILE_SLOTS_H_
\ No newline at end of file
@@ -0,0 +1,286 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file profiler.cpp
+/// @brief Class to measure exact CPU cycle counts of sections of the control loop.
+
+#include "profiler.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "motion_planner.h"
+
+#if defined(MTSPIN_PROFILING)
+
+#if !defined(__AVR__)
+#error "MTSPIN_PROFILING requires an AVR target (Timer1 is used as the cycle counter)."
+#endif
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace {
+
+const uint8_t kSizeOfStepTrace = 32; ///< No. of step timestamps in the step trace.
+const uint8_t kStepTraceDecimation = 8; ///< Only every nth step is timestamped, so the trace covers a full ramp.
+
+/// @brief No. of Timer1 overflows (upper 16 bits of the cycle count).
+volatile uint16_t timer1_overflows = 0;
+
+volatile uint8_t* pul_input_register = nullptr; ///< Input register of the stepper driver PUL pin.
+uint8_t pul_bit_mask = 0; ///< Bit mask of the stepper driver PUL pin.
+volatile uint16_t trace_step_count = 0; ///< No. of steps since the step trace was armed.
+volatile uint8_t trace_size = 0; ///< No. of timestamps in the step trace.
+volatile uint32_t step_trace_cycles[kSizeOfStepTrace]; ///< Cycle counts of every nth step since the trace was armed.
+
+/// @brief Get the current cycle count; interrupts must be disabled.
+/// @return The no. of CPU cycles since Timer1 was started.
+inline uint32_t ReadTimer1Cycles() {
+  uint16_t count = TCNT1;
+  uint16_t overflows = timer1_overflows;
+  // Account for an overflow that occurred after interrupts were disabled.
+  if ((TIFR1 & _BV(TOV1)) && count < 0x8000) overflows++;
+  return (static_cast<uint32_t>(overflows) << 16) | count;
+}
+
+} // namespace
+
+/// @brief Timer1 overflow interrupt service routine.
+ISR(TIMER1_OVF_vect) {
+  timer1_overflows++;
+}
+
+// Only the PCINT0 vector is claimed, leaving the other pin change vectors free (e.g., for SoftwareSerial).
+static_assert(mtspin::Configuration::kPulPin_ >= 8 && mtspin::Configuration::kPulPin_ <= 13,
+              "MTSPIN_PROFILING requires the PUL pin on port B (pins 8 to 13; PCINT0).");
+
+/// @brief Pin change interrupt service routine; timestamps steps (rising edges, or both edges with double-edge
+/// stepping) of the stepper driver PUL pin.
+ISR(PCINT0_vect) {
+  uint32_t cycles = ReadTimer1Cycles();
+  if (!mtspin::Configuration::kDoubleEdgeStepping_ && (*pul_input_register & pul_bit_mask) == 0) return; // Falling edge.
+  if (trace_step_count % kStepTraceDecimation == 0 && trace_size < kSizeOfStepTrace) {
+    step_trace_cycles[trace_size] = cycles;
+    trace_size++;
+  }
+
+  trace_step_count++;
+}
+
+#endif // MTSPIN_PROFILING
+
+namespace mtspin {
+
+Profiler::Profiler() {
+#if defined(MTSPIN_PROFILING)
+  Reset();
+#endif
+}
+
+Profiler::~Profiler() {}
+
+void Profiler::Begin() {
+#if defined(MTSPIN_PROFILING)
+  // Run Timer1 in normal mode with no prescaler, so it counts CPU cycles.
+  uint8_t sreg = SREG;
+  cli();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  timer1_overflows = 0;
+  TIFR1 = _BV(TOV1); // Clear any pending overflow.
+  TIMSK1 = _BV(TOIE1);
+
+  // Timestamp step pulses with a pin change interrupt on the (output) PUL pin.
+  const uint8_t pul_pin = Configuration::GetInstance().kPulPin_;
+  pul_input_register = portInputRegister(digitalPinToPort(pul_pin));
+  pul_bit_mask = digitalPinToBitMask(pul_pin);
+  *digitalPinToPCMSK(pul_pin) |= _BV(digitalPinToPCMSKbit(pul_pin));
+  PCICR |= _BV(digitalPinToPCICRbit(pul_pin));
+  SREG = sreg;
+
+  // Measure the cost of an empty measurement.
+  uint32_t start_cycles = ReadCycles();
+  overhead_cycles_ = static_cast<uint16_t>(ReadCycles() - start_cycles);
+  Reset();
+#endif
+}
+
+uint32_t Profiler::ReadCycles() const {
+#if defined(MTSPIN_PROFILING)
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t cycles = ReadTimer1Cycles();
+  SREG = sreg;
+  return cycles;
+#else
+  return 0;
+#endif
+}
+
+void Profiler::Record(Section section, uint32_t start_cycles) {
+#if defined(MTSPIN_PROFILING)
+  Update(statistics_[static_cast<uint8_t>(section)], start_cycles);
+#else
+  (void)section;
+  (void)start_cycles;
+#endif
+}
+
+void Profiler::RecordState(Configuration::ControlMode control_mode, mt::StepperDriver::PowerState power_state,
+                           MotionPlanner::MotionStatus motion_status, uint32_t start_cycles) {
+#if defined(MTSPIN_PROFILING)
+  // State index = (mode x 6) + (power x 3) + motion, where motion is 0 (idle), 1 (ramping) or 2 (constant speed).
+  uint8_t state = 0;
+  if (control_mode == Configuration::ControlMode::kOscillate || control_mode == Configuration::ControlMode::kCalibrate) {
+    state += 6; // Sweep modes.
+  }
+  else if (control_mode != Configuration::ControlMode::kContinuous) {
+    state += 12; // Trajectory modes.
+  }
+
+  if (power_state == mt::StepperDriver::PowerState::kEnabled) state += 3;
+  if (motion_status == MotionPlanner::MotionStatus::kConstantSpeed) {
+    state += 2;
+  }
+  else if (motion_status != MotionPlanner::MotionStatus::kIdle) {
+    state += 1;
+  }
+
+  Update(state_statistics_[state], start_cycles);
+#else
+  (void)control_mode;
+  (void)power_state;
+  (void)motion_status;
+  (void)start_cycles;
+#endif
+}
+
+void Profiler::ArmStepTrace() {
+#if defined(MTSPIN_PROFILING)
+  uint8_t sreg = SREG;
+  cli();
+  trace_step_count = 0;
+  trace_size = 0;
+  SREG = sreg;
+#endif
+}
+
+void Profiler::RecordInvariantViolation() {
+  invariant_violations_++;
+}
+
+void Profiler::Reset() {
+#if defined(MTSPIN_PROFILING)
+  for (uint8_t i = 0; i < (kSizeOfStatistics_ + kSizeOfStates_); i++) {
+    Statistics& statistics = (i < kSizeOfStatistics_) ? statistics_[i] : state_statistics_[i - kSizeOfStatistics_];
+    statistics.count = 0;
+    statistics.min_cycles = UINT32_MAX;
+    statistics.max_cycles = 0;
+    statistics.total_cycles = 0;
+  }
+#endif
+
+  invariant_violations_ = 0;
+}
+
+void Profiler::Report() const {
+#if defined(MTSPIN_PROFILING)
+  MTSPIN_SERIAL.println(F("section,count,min_cycles,max_cycles,mean_cycles"));
+  for (uint8_t i = 0; i < kSizeOfStatistics_; i++) {
+    switch (static_cast<Section>(i)) {
+      case Section::kLoop: MTSPIN_SERIAL.print(F("loop")); break;
+      case Section::kInput: MTSPIN_SERIAL.print(F("input")); break;
+      case Section::kAction: MTSPIN_SERIAL.print(F("action")); break;
+      case Section::kContinuous: MTSPIN_SERIAL.print(F("continuous")); break;
+      case Section::kOscillate: MTSPIN_SERIAL.print(F("oscillate")); break;
+      case Section::kTrajectory: MTSPIN_SERIAL.print(F("trajectory")); break;
+      default: break;
+    }
+
+    PrintStatistics(statistics_[i]);
+  }
+
+  // Worst-case execution time (WCET) table of the control loop, for each state that was visited.
+  MTSPIN_SERIAL.println(F("state,count,min_cycles,max_cycles,mean_cycles"));
+  for (uint8_t i = 0; i < kSizeOfStates_; i++) {
+    if (state_statistics_[i].count == 0) continue;
+    switch (i / 6) {
+      case 0: MTSPIN_SERIAL.print(F("continuous")); break;
+      case 1: MTSPIN_SERIAL.print(F("oscillate")); break;
+      default: MTSPIN_SERIAL.print(F("trajectory")); break;
+    }
+
+    MTSPIN_SERIAL.print(((i / 3) % 2 == 0) ? F("/disabled") : F("/enabled"));
+    switch (i % 3) {
+      case 0: MTSPIN_SERIAL.print(F("/idle")); break;
+      case 1: MTSPIN_SERIAL.print(F("/ramping")); break;
+      default: MTSPIN_SERIAL.print(F("/constant")); break;
+    }
+
+    PrintStatistics(state_statistics_[i]);
+  }
+
+  MTSPIN_SERIAL.print(F("invariant_violations,"));
+  MTSPIN_SERIAL.println(invariant_violations_);
+
+  // Step trace of the most recent ramp, with the settings needed to compare it to an ideal constant acceleration.
+  const Configuration& configuration = Configuration::GetInstance();
+  MTSPIN_SERIAL.print(F("f_cpu_hz,"));
+  MTSPIN_SERIAL.println(F_CPU);
+  MTSPIN_SERIAL.print(F("acceleration_microsteps_per_s_per_s,"));
+  MTSPIN_SERIAL.println(configuration.kAcceleration_microsteps_per_s_per_s_);
+  MTSPIN_SERIAL.print(F("deceleration_microsteps_per_s_per_s,"));
+  MTSPIN_SERIAL.println(configuration.kDeceleration_microsteps_per_s_per_s_);
+  MTSPIN_SERIAL.println(F("step,cycles"));
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t size = trace_size;
+  SREG = sreg;
+  uint32_t min_interval_cycles = UINT32_MAX;
+  for (uint8_t i = 0; i < size; i++) {
+    uint32_t cycles = step_trace_cycles[i] - step_trace_cycles[0];
+    if (i > 0 && (step_trace_cycles[i] - step_trace_cycles[i - 1]) < min_interval_cycles) {
+      min_interval_cycles = step_trace_cycles[i] - step_trace_cycles[i - 1];
+    }
+
+    MTSPIN_SERIAL.print(static_cast<uint16_t>(i) * kStepTraceDecimation);
+    MTSPIN_SERIAL.print(F(","));
+    MTSPIN_SERIAL.println(cycles);
+  }
+
+  // Shortest interval between traced steps, per step; the peak step rate reached is F_CPU divided by this.
+  MTSPIN_SERIAL.print(F("min_step_interval_cycles,"));
+  MTSPIN_SERIAL.println((size > 1) ? (min_interval_cycles / kStepTraceDecimation) : 0);
+#else
+  MTSPIN_SERIAL.println(F("profiling not compiled in"));
+#endif
+}
+
+#if defined(MTSPIN_PROFILING)
+void Profiler::Update(Statistics& statistics, uint32_t start_cycles) {
+  uint32_t cycles = ReadCycles() - start_cycles;
+  cycles = (cycles > overhead_cycles_) ? (cycles - overhead_cycles_) : 0;
+  statistics.count++;
+  if (cycles < statistics.min_cycles) statistics.min_cycles = cycles;
+  if (cycles > statistics.max_cycles) statistics.max_cycles = cycles;
+  statistics.total_cycles += cycles;
+}
+
+void Profiler::PrintStatistics(const Statistics& statistics) {
+  uint32_t mean_cycles = (statistics.count > 0) ? static_cast<uint32_t>(statistics.total_cycles / statistics.count) : 0;
+  MTSPIN_SERIAL.print(F(","));
+  MTSPIN_SERIAL.print(statistics.count);
+  MTSPIN_SERIAL.print(F(","));
+  MTSPIN_SERIAL.print((statistics.count > 0) ? statistics.min_cycles : 0);
+  MTSPIN_SERIAL.print(F(","));
+  MTSPIN_SERIAL.print(statistics.max_cycles);
+  MTSPIN_SERIAL.print(F(","));
+  MTSPIN_SERIAL.println(mean_cycles);
+}
+#endif
+
+} // namespace mtspin
\ No newline at end of file
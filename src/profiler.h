@@ -0,0 +1,112 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file profiler.h
+/// @brief Class to measure exact CPU cycle counts of sections of the control loop.
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <Arduino.h>
+#include <stepper_driver.h>
+
+#include "configuration.h"
+#include "motion_planner.h"
+
+namespace mtspin {
+
+/// @brief The Profiler class.
+/// Cycle counts are taken from Timer1 running free at the CPU clock, so results are exact on the target and
+/// under an instruction-level AVR simulator (e.g., simavr). Step pulses are timestamped by a pin change interrupt
+/// on the PUL pin. All methods compile to no-ops, and the statistics are not allocated, unless MTSPIN_PROFILING is
+/// defined (see configuration.h).
+class Profiler {
+ public:
+
+  /// @brief Enum of profiled sections.
+  enum class Section {
+    kLoop = 0, ///< One complete iteration of the control loop.
+    kInput, ///< Button and serial input checks.
+    kAction, ///< Processing of the control action.
+    kContinuous, ///< Continuous mode motion call.
+    kOscillate, ///< Oscillate (or calibration) mode motion call.
+    kTrajectory, ///< PVT, track or gearing (followed trajectory) mode motion call.
+    kCount, ///< No. of sections (not a section).
+  };
+
+  /// @brief Construct a Profiler object.
+  Profiler();
+
+  /// @brief Destroy the Profiler object.
+  ~Profiler();
+
+  /// @brief Start the cycle counter (Timer1) and measure the measurement overhead.
+  void Begin(); ///< This must be called only once.
+
+  /// @brief Get the current cycle count.
+  /// @return The no. of CPU cycles since Begin() (wraps around every 2^32 cycles).
+  uint32_t ReadCycles() const;
+
+  /// @brief Record a measurement for a section.
+  /// @param section The profiled section.
+  /// @param start_cycles The cycle count at the start of the section, from ReadCycles().
+  void Record(Section section, uint32_t start_cycles);
+
+  /// @brief Record a measurement of a complete control loop iteration against the control system state.
+  /// The worst case for each state gives the worst-case execution time (WCET) table of the control loop.
+  /// @param control_mode The control mode at the start of the iteration.
+  /// @param power_state The stepper driver power state at the start of the iteration.
+  /// @param motion_status The motion status at the start of the iteration.
+  /// @param start_cycles The cycle count at the start of the iteration, from ReadCycles().
+  void RecordState(Configuration::ControlMode control_mode, mt::StepperDriver::PowerState power_state,
+                   MotionPlanner::MotionStatus motion_status, uint32_t start_cycles);
+
+  /// @brief Start a new step trace; the timestamps of the following steps are recorded (from the PUL pin).
+  /// Call at the start of a motion from standstill to capture the acceleration ramp.
+  void ArmStepTrace();
+
+  /// @brief Record a violation of a control system invariant.
+  void RecordInvariantViolation();
+
+  /// @brief Clear all recorded measurements.
+  void Reset();
+
+  /// @brief Report all recorded measurements over serial, as comma separated values (CSV).
+  void Report() const;
+
+ private:
+
+  /// @brief Measurement statistics for a single section.
+  struct Statistics {
+    uint32_t count; ///< No. of measurements.
+    uint32_t min_cycles; ///< Minimum no. of cycles.
+    uint32_t max_cycles; ///< Maximum no. of cycles.
+    uint64_t total_cycles; ///< Sum of all measurements (cycles).
+  };
+
+#if defined(MTSPIN_PROFILING)
+  /// @brief Add a measurement to a set of statistics.
+  /// @param statistics The statistics to update.
+  /// @param start_cycles The cycle count at the start of the measurement, from ReadCycles().
+  void Update(Statistics& statistics, uint32_t start_cycles);
+
+  /// @brief Print a set of statistics over serial, as the count, min, max and mean columns of a CSV row.
+  /// @param statistics The statistics to print.
+  static void PrintStatistics(const Statistics& statistics);
+#endif
+
+  static const uint8_t kSizeOfStatistics_ = static_cast<uint8_t>(Section::kCount); ///< No. of profiled sections.
+  static const uint8_t kSizeOfStates_ = 18; ///< No. of states; 3 control mode groups (continuous, sweep and trajectory modes) x 2 power states x 3 motion states.
+#if defined(MTSPIN_PROFILING)
+  Statistics statistics_[kSizeOfStatistics_]; ///< Measurement statistics for each section.
+  Statistics state_statistics_[kSizeOfStates_]; ///< Measurement statistics for each control system state.
+  uint16_t overhead_cycles_ = 0; ///< Cycles taken by two back-to-back ReadCycles() calls; subtracted from measurements.
+#endif
+  uint32_t invariant_violations_ = 0; ///< No. of control system invariant violations.
+};
+
+} // namespace mtspin
+
+#endif // PROFILER_H_
\ No newline at end of file
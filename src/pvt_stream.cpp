@@ -0,0 +1,93 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file pvt_stream.cpp
+/// @brief Class to buffer a streamed position-velocity-time (PVT) trajectory.
+
+#include "pvt_stream.h"
+
+#include <Arduino.h>
+#include <ArduinoLog.h>
+
+#include "configuration.h"
+#include "frame_link.h"
+#include "trajectory.h"
+
+namespace mtspin {
+
+PvtStream::PvtStream() {}
+
+PvtStream::~PvtStream() {}
+
+void PvtStream::Begin() {
+  Restart();
+  head_ = 0;
+  count_ = 0;
+  owed_credits_ = 0;
+  points_received_ = 0;
+  frame_errors_ = 0;
+  uint8_t credits = kSizeOfBuffer_;
+  FrameLink::Send(FrameLink::FrameType::kStart, &credits, 1);
+}
+
+void PvtStream::Queue(const uint8_t* payload, uint8_t size) {
+#if defined(MTSPIN_PVT_STREAMING)
+  if (size != kSizeOfPayload_) {
+    Reject();
+    return;
+  }
+
+  if (count_ == kSizeOfBuffer_) {
+    // The host sent more points than it had credits for.
+    frame_errors_++;
+    return;
+  }
+
+  uint8_t tail = head_ + count_;
+  if (tail >= kSizeOfBuffer_) tail -= kSizeOfBuffer_;
+  Point& point = buffer_[tail];
+  point.position = static_cast<int32_t>(FrameLink::ReadUint32(&payload[0]));
+  point.velocity = static_cast<int16_t>(FrameLink::ReadUint16(&payload[4]));
+  point.duration_ms = FrameLink::ReadUint16(&payload[6]);
+  count_++;
+  points_received_++;
+#else
+  (void)payload;
+  (void)size;
+  Reject();
+#endif
+}
+
+void PvtStream::Reject() {
+  frame_errors_++;
+  owed_credits_++;
+}
+
+void PvtStream::ReportCredits() {
+  if (owed_credits_ == 0) return;
+  FrameLink::Send(FrameLink::FrameType::kCredit, &owed_credits_, 1);
+  owed_credits_ = 0;
+}
+
+void PvtStream::LogStatistics() const {
+  Log.noticeln(F("PVT points received: %u, buffered: %d, frame errors: %d, underruns: %d"), points_received_,
+               count_, frame_errors_, underruns_);
+}
+
+bool PvtStream::StartNextSegment() {
+#if defined(MTSPIN_PVT_STREAMING)
+  if (count_ == 0) return false;
+  const Point& point = buffer_[head_];
+  StartSegment(static_cast<float>(point.position), static_cast<float>(point.velocity), point.duration_ms);
+  head_ = (head_ + 1 < kSizeOfBuffer_) ? (head_ + 1) : 0;
+  count_--;
+  owed_credits_++; // The slot is free again.
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,86 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file pvt_stream.h
+/// @brief Class to buffer a streamed position-velocity-time (PVT) trajectory.
+
+#ifndef PVT_STREAM_H_
+#define PVT_STREAM_H_
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "trajectory.h"
+
+namespace mtspin {
+
+/// @brief The PVT Stream class.
+/// Trajectory points (position, velocity and segment duration) are received in point frames (see FrameLink), and
+/// queued in a ring buffer. Flow control is credit-based: the host may only send as many points as it holds
+/// credits, which are granted when the stream starts (one per buffer slot) and returned as points are consumed, so
+/// the buffer never overruns. Point frame payload: int32 position (centidegrees), int16 velocity (centidegrees per
+/// second) and uint16 duration (ms) of the segment to the point. The buffer is not allocated, and points are
+/// rejected, unless MTSPIN_PVT_STREAMING is defined (see configuration.h).
+class PvtStream : public Trajectory {
+ public:
+
+  static const uint8_t kSizeOfBuffer_ = 16; ///< No. of trajectory points buffered.
+  static const uint8_t kSizeOfPayload_ = 8; ///< Payload size (bytes) of a point frame.
+
+  /// @brief Construct a PVT Stream object.
+  PvtStream();
+
+  /// @brief Destroy the PVT Stream object.
+  ~PvtStream();
+
+  /// @brief Start (or restart) the stream from the origin, at rest; clears the buffer and grants all the credits.
+  void Begin();
+
+  /// @brief Queue a point; rejected if the payload size is wrong, or the buffer is full (i.e., the host sent it
+  /// without a credit).
+  /// @param payload The point frame payload.
+  /// @param size The payload size (bytes).
+  void Queue(const uint8_t* payload, uint8_t size);
+
+  /// @brief Reject a corrupted point; its credit is returned, so the host can resend it.
+  void Reject();
+
+  /// @brief Send any credits owed to the host.
+  void ReportCredits();
+
+  /// @brief Log the stream statistics.
+  void LogStatistics() const;
+
+ protected:
+
+  /// @brief Start the segment to the oldest buffered point.
+  /// @return True if a segment was started; false if the buffer is empty.
+  bool StartNextSegment() override;
+
+ private:
+
+  /// @brief A trajectory point.
+  struct Point {
+    int32_t position; ///< Position (centidegrees).
+    int16_t velocity; ///< Velocity (centidegrees per second).
+    uint16_t duration_ms; ///< Duration (ms) of the segment ending at this point.
+  };
+
+  // Buffer and flow control.
+#if defined(MTSPIN_PVT_STREAMING)
+  Point buffer_[kSizeOfBuffer_]; ///< Trajectory points; a ring buffer.
+#endif
+  uint8_t head_ = 0; ///< Index of the oldest point.
+  uint8_t count_ = 0; ///< No. of points buffered.
+  uint8_t owed_credits_ = 0; ///< No. of credits to return to the host.
+
+  // Statistics.
+  uint32_t points_received_ = 0; ///< No. of points received and queued.
+  uint16_t frame_errors_ = 0; ///< No. of points rejected (corrupted, wrong size or full buffer).
+};
+
+} // namespace mtspin
+
+#endif // PVT_STREAM_H_
\ No newline at end of file
@@ -0,0 +1,141 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file schedule.cpp
+/// @brief Class to keep the time of day, synced from a host, and follow a weekly operating schedule stored in EEPROM.
+
+#include "schedule.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "frame_link.h"
+
+namespace mtspin {
+
+Schedule::Schedule(uint16_t eeprom_address) : eeprom_address_(eeprom_address) {}
+
+Schedule::~Schedule() {}
+
+bool Schedule::Load() {
+  uint8_t size = EEPROM.read(eeprom_address_ + 1);
+  bool stored = (EEPROM.read(eeprom_address_) == kVersion_) && size > 0 && Valid(eeprom_address_);
+  size_ = stored ? size : 0;
+  deadline_ms_ = millis(); // Apply the state now.
+  return stored;
+}
+
+bool Schedule::SetClock(const uint8_t* payload, uint8_t size) {
+  if (size != 4) return false;
+  uint32_t second_of_week = FrameLink::ReadUint32(payload);
+  if (second_of_week >= kMillisecondsPerWeek_ / 1000UL) return false;
+  uint32_t ms_of_week = second_of_week * 1000UL;
+
+  uint32_t now_ms = millis();
+  uint32_t since_last_set_ms = now_ms - last_set_ms_;
+  if (clock_set_ && since_last_set_ms >= kMinDriftInterval_ms_) {
+    // The clock error (wrapped to within half a week) over the time since it was last set is the remaining drift.
+    int32_t error_ms = static_cast<int32_t>(ms_of_week - MillisecondsOfWeek(now_ms));
+    if (error_ms > static_cast<int32_t>(kMillisecondsPerWeek_ / 2)) error_ms -= kMillisecondsPerWeek_;
+    else if (error_ms < -static_cast<int32_t>(kMillisecondsPerWeek_ / 2)) error_ms += kMillisecondsPerWeek_;
+    float drift = drift_ + (static_cast<float>(error_ms) / since_last_set_ms);
+    if (drift > kMaxDrift_) drift = kMaxDrift_;
+    else if (drift < -kMaxDrift_) drift = -kMaxDrift_;
+    drift_ = drift;
+  }
+
+  base_ms_ = now_ms;
+  base_ms_of_week_ = ms_of_week;
+  last_set_ms_ = now_ms;
+  clock_set_ = true;
+  deadline_ms_ = now_ms; // Apply the state at the new time now.
+  return true;
+}
+
+bool Schedule::StoreEntry(const uint8_t* payload, uint8_t size) {
+  if (size != 3 || payload[0] >= kMaxSizeOfSchedule_) return false;
+
+  // Empty the schedule first, so a partly stored schedule is never followed.
+  EEPROM.update(eeprom_address_ + 1, 0);
+  size_ = 0;
+  EEPROM.put(eeprom_address_ + 2 + (2 * payload[0]), FrameLink::ReadUint16(&payload[1]));
+  return true;
+}
+
+bool Schedule::StoreLength(const uint8_t* payload, uint8_t size) {
+  if (size != 1 || payload[0] > kMaxSizeOfSchedule_) return false;
+  EEPROM.update(eeprom_address_, kVersion_);
+  EEPROM.update(eeprom_address_ + 1, payload[0]);
+  return Load() || payload[0] == 0;
+}
+
+bool Schedule::Valid(uint16_t eeprom_address) {
+  if (EEPROM.read(eeprom_address) != kVersion_) return true;
+  uint8_t size = EEPROM.read(eeprom_address + 1);
+  if (size > kMaxSizeOfSchedule_) return false;
+
+  // The entries must be in ascending time, within the week.
+  uint16_t last_minute = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    uint16_t entry = 0;
+    EEPROM.get(eeprom_address + 2 + (2 * i), entry);
+    uint16_t minute = entry & ~kRunFlag_;
+    if (minute >= kMinutesPerWeek_ || (i > 0 && minute <= last_minute)) return false;
+    last_minute = minute;
+  }
+
+  return true;
+}
+
+void Schedule::set_eeprom_address(uint16_t eeprom_address) {
+  eeprom_address_ = eeprom_address;
+}
+
+bool Schedule::Due() const {
+  return active() && static_cast<int32_t>(millis() - deadline_ms_) >= 0;
+}
+
+bool Schedule::Advance() {
+  uint32_t now_ms = millis();
+  uint32_t ms_of_week = MillisecondsOfWeek(now_ms);
+
+  // Re-base the clock, so the time since the base never overflows (there is a transition at least once a week).
+  base_ms_ = now_ms;
+  base_ms_of_week_ = ms_of_week;
+
+  // The current entry is the last at or before now; before the first entry, it is the last of the previous week.
+  uint16_t minute = static_cast<uint16_t>(ms_of_week / 60000UL);
+  uint8_t next_index = 0;
+  while (next_index < size_ && (ReadEntry(next_index) & ~kRunFlag_) <= minute) next_index++;
+  uint16_t current = ReadEntry((next_index > 0) ? (next_index - 1) : (size_ - 1));
+
+  // The next transition is the next entry, or the first entry of the next week.
+  uint32_t next_ms_of_week = (ReadEntry((next_index < size_) ? next_index : 0) & ~kRunFlag_) * 60000UL;
+  if (next_index == size_) next_ms_of_week += kMillisecondsPerWeek_;
+  deadline_ms_ = now_ms + static_cast<uint32_t>((next_ms_of_week - ms_of_week) / (1.0F + drift_));
+  return (current & kRunFlag_) != 0;
+}
+
+bool Schedule::active() const {
+  return clock_set_ && size_ > 0;
+}
+
+uint16_t Schedule::minute_of_week() const {
+  return clock_set_ ? static_cast<uint16_t>(MillisecondsOfWeek(millis()) / 60000UL) : 0;
+}
+
+uint16_t Schedule::ReadEntry(uint8_t index) const {
+  uint16_t entry = 0;
+  EEPROM.get(eeprom_address_ + 2 + (2 * index), entry);
+  return entry;
+}
+
+uint32_t Schedule::MillisecondsOfWeek(uint32_t now_ms) const {
+  uint32_t elapsed_ms = now_ms - base_ms_;
+  uint32_t corrected_ms = elapsed_ms + static_cast<int32_t>(elapsed_ms * drift_);
+  return (base_ms_of_week_ + (corrected_ms % kMillisecondsPerWeek_)) % kMillisecondsPerWeek_;
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,118 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file schedule.h
+/// @brief Class to keep the time of day, synced from a host, and follow a weekly operating schedule stored in EEPROM.
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The Schedule class.
+/// The wall-clock time (of the week) is kept from millis(), set by clock frames from a host. The clock drift (of the
+/// board's resonator) is measured between clock frames, and corrected for. The schedule is a list of transitions,
+/// each a time of the week and whether the motor runs from then on, so a day's opening hours take two entries. The
+/// schedule is only evaluated at a transition: the time until the next one is converted to a millis() deadline, so
+/// each loop costs a single timestamp compare.
+///
+/// EEPROM layout: a version byte (kVersion_; anything else means no schedule), the no. of entries, then the entries
+/// (uint16 minute of the week (from Monday 00:00), plus kRunFlag_ if the motor runs; 2 bytes each), in ascending
+/// time. Entry frame payload: uint8 index and uint16 entry; schedule frame payload: uint8 no. of entries (0 to
+/// erase). Clock frame payload: uint32 second of the week (from Monday 00:00).
+class Schedule {
+ public:
+
+  static const uint8_t kMaxSizeOfSchedule_ = 28; ///< Max no. of entries (e.g., opening and closing for each day, twice).
+  static const uint16_t kSizeOfEeprom_ = 2 + (2 * kMaxSizeOfSchedule_); ///< EEPROM used by the schedule (bytes).
+
+  /// @brief Construct a Schedule object.
+  /// @param eeprom_address The EEPROM address of the schedule.
+  explicit Schedule(uint16_t eeprom_address);
+
+  /// @brief Destroy the Schedule object.
+  ~Schedule();
+
+  /// @brief Load the schedule; its state is applied at the next check if the clock is set.
+  /// @return True if a valid schedule is stored.
+  bool Load();
+
+  /// @brief Set the clock, measuring the drift since the last time it was set.
+  /// @param payload The clock frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if set; false if the payload is invalid.
+  bool SetClock(const uint8_t* payload, uint8_t size);
+
+  /// @brief Store an entry; the stored schedule is emptied until its length is stored (see StoreLength()).
+  /// @param payload The entry frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored; false if the payload is invalid.
+  bool StoreEntry(const uint8_t* payload, uint8_t size);
+
+  /// @brief Store the no. of entries, completing (or erasing) the schedule, and load it.
+  /// @param payload The schedule frame payload.
+  /// @param size The payload size (bytes).
+  /// @return True if stored and valid (e.g., in ascending time); false otherwise.
+  bool StoreLength(const uint8_t* payload, uint8_t size);
+
+  /// @brief Check that the schedule stored at an address, if any, is valid (e.g., in ascending time).
+  /// @param eeprom_address The EEPROM address of the schedule.
+  /// @return True if valid, or no schedule is stored.
+  static bool Valid(uint16_t eeprom_address);
+
+  /// @brief Set the EEPROM address of the schedule (e.g., when the configuration bank changes); then call Load().
+  /// @param eeprom_address The EEPROM address of the schedule.
+  void set_eeprom_address(uint16_t eeprom_address);
+
+  /// @brief Check whether a transition is due (or the schedule was just loaded, or the clock set).
+  /// @return True if due; then call Advance().
+  bool Due() const; ///< This must be called repeatedly.
+
+  /// @brief Find the state at the current time, and the deadline of the next transition.
+  /// @return True if the motor runs from now on.
+  bool Advance();
+
+  /// @brief Get whether the schedule is in use, i.e., stored and the clock is set.
+  /// @return True if in use.
+  bool active() const;
+
+  /// @brief Get the time of the week.
+  /// @return The time (minutes from Monday 00:00).
+  uint16_t minute_of_week() const;
+
+ private:
+
+  static const uint8_t kVersion_ = 1; ///< Version of the stored schedule layout.
+  static const uint16_t kRunFlag_ = 0x8000; ///< Flag in an entry set if the motor runs from the entry's time.
+  static const uint16_t kMinutesPerWeek_ = 10080; ///< No. of minutes per week.
+  static const uint32_t kMillisecondsPerWeek_ = 604800000UL; ///< No. of milliseconds per week.
+  static const uint32_t kMinDriftInterval_ms_ = 600000UL; ///< Min time (ms) between clock frames to measure the drift.
+  static constexpr float kMaxDrift_ = 0.01F; ///< Max clock drift (fraction); resonators are within 0.5%.
+
+  /// @brief Read an entry from EEPROM.
+  /// @param index The entry index.
+  /// @return The entry.
+  uint16_t ReadEntry(uint8_t index) const;
+
+  /// @brief Get the time of the week, from the clock.
+  /// @param now_ms The current millis() time (ms).
+  /// @return The time (ms from Monday 00:00).
+  uint32_t MillisecondsOfWeek(uint32_t now_ms) const;
+
+  uint16_t eeprom_address_; ///< The EEPROM address of the schedule.
+  uint8_t size_ = 0; ///< No. of entries; 0 if no schedule is stored.
+  bool clock_set_ = false; ///< Whether the clock has been set by the host.
+  uint32_t base_ms_ = 0; ///< The millis() time (ms) of the clock base.
+  uint32_t base_ms_of_week_ = 0; ///< Time of the week (ms) at the clock base.
+  uint32_t last_set_ms_ = 0; ///< The millis() time (ms) the clock was last set.
+  float drift_ = 0.0F; ///< Clock drift (fraction of the elapsed millis() time to add).
+  uint32_t deadline_ms_ = 0; ///< The millis() time (ms) of the next transition.
+};
+
+} // namespace mtspin
+
+#endif // SCHEDULE_H_
\ No newline at end of file
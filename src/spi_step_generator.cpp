@@ -0,0 +1,132 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file spi_step_generator.cpp
+/// @brief Class to generate step pulse trains at constant speed by shifting bit patterns out of the SPI peripheral.
+
+#include "spi_step_generator.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+#if defined(MTSPIN_SPI_STEPPING)
+
+#if !defined(__AVR__)
+#error "MTSPIN_SPI_STEPPING requires an AVR target (the SPI peripheral shifts out the step pulses)."
+#endif
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace {
+
+const float kBitRate_Hz = F_CPU / 128.0F; ///< SPI bit rate (Hz); the slowest SPI clock, to minimise interrupts.
+
+uint16_t phase = 0; ///< The phase accumulator; a step (1 bit) is output each time it overflows.
+volatile uint16_t phase_increment = 0; ///< Phase added each bit; the step rate as a fraction (of 2^16) of the bit rate.
+uint8_t next_pattern = 0; ///< The next byte to shift out.
+uint8_t next_pattern_steps = 0; ///< No. of steps in the next byte.
+volatile uint16_t step_count = 0; ///< No. of steps shifted out since they were last taken by TakeSteps().
+volatile uint8_t byte_count = 0; ///< No. of bytes shifted out (wraps around).
+
+/// @brief Prepare the next byte of the step pulse train, most significant bit first.
+inline void PrepareNextPattern() {
+  uint8_t pattern = 0;
+  uint8_t steps = 0;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    uint16_t previous_phase = phase;
+    phase += phase_increment;
+    pattern <<= 1;
+    if (phase < previous_phase) {
+      pattern |= 1;
+      steps++;
+    }
+  }
+
+  next_pattern = pattern;
+  next_pattern_steps = steps;
+}
+
+} // namespace
+
+/// @brief SPI serial transfer complete interrupt service routine; loads the next byte of the step pulse train.
+ISR(SPI_STC_vect) {
+  // If the steps have not been taken for so long that the count could wrap, empty bytes are shifted out instead, so
+  // no step is output without being counted.
+  bool room = (step_count <= 0xFFFF - 8);
+  SPDR = room ? next_pattern : 0; // First, to keep the gap between bytes short.
+  if (room) step_count += next_pattern_steps;
+  byte_count++;
+  PrepareNextPattern();
+}
+
+#endif // MTSPIN_SPI_STEPPING
+
+namespace mtspin {
+
+SpiStepGenerator::SpiStepGenerator() {}
+
+SpiStepGenerator::~SpiStepGenerator() {}
+
+void SpiStepGenerator::Start(float step_rate) {
+#if defined(MTSPIN_SPI_STEPPING)
+  // At most one step every other bit, so pulses are always separated by a 0 bit.
+  float increment = step_rate * 65536.0F / kBitRate_Hz;
+  uint16_t new_phase_increment = (increment >= 32768.0F) ? 32768 : static_cast<uint16_t>(increment);
+
+  uint8_t sreg = SREG;
+  cli();
+  phase_increment = new_phase_increment;
+  if (!active_) {
+    // Master mode 0, MSB first, F_CPU / 128; the SS pin must be an output so master mode is kept.
+    pinMode(PIN_SPI_SS, OUTPUT);
+    SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPIE) | _BV(SPR1) | _BV(SPR0);
+    SPSR = 0;
+    PrepareNextPattern();
+    SPDR = 0; // Start the transfers; the first byte is empty.
+    active_ = true;
+  }
+  SREG = sreg;
+#else
+  (void)step_rate;
+#endif
+}
+
+void SpiStepGenerator::Stop(uint8_t pul_pin) {
+#if defined(MTSPIN_SPI_STEPPING)
+  if (!active_) return;
+
+  // Let the byte being shifted out and the prepared byte finish, so no pulse is cut short; the bytes after are empty.
+  phase_increment = 0;
+  uint8_t start_byte_count = byte_count;
+  while (static_cast<uint8_t>(byte_count - start_byte_count) < 2) {}
+
+  SPCR = 0;
+  digitalWrite(pul_pin, LOW);
+  active_ = false;
+#else
+  (void)pul_pin;
+#endif
+}
+
+uint16_t SpiStepGenerator::TakeSteps() {
+#if defined(MTSPIN_SPI_STEPPING)
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t steps = step_count;
+  step_count = 0;
+  SREG = sreg;
+  return steps;
+#else
+  return 0;
+#endif
+}
+
+bool SpiStepGenerator::active() const {
+  return active_;
+}
+
+} // namespace mtspin
\ No newline at end of file
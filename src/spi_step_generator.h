@@ -0,0 +1,56 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file spi_step_generator.h
+/// @brief Class to generate step pulse trains at constant speed by shifting bit patterns out of the SPI peripheral.
+
+#ifndef SPI_STEP_GENERATOR_H_
+#define SPI_STEP_GENERATOR_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The SPI Step Generator class (experimental).
+/// The PUL pin must be the SPI MOSI pin (pin 11 on the Uno), and the MISO and SCK pins (12 and 13) must not be used
+/// for other outputs, as the SPI peripheral takes them over while it runs. Step pulses are encoded one bit per SPI
+/// bit clock, with a 1 for each step (from a phase accumulator), and shifted out a byte at a time; the SPI interrupt
+/// only loads the next byte, so the CPU cost is almost independent of the step rate. For constant speeds only; the
+/// gap while each byte is loaded stretches the bit clock slightly, so the speed is a little (a few %) lower than set,
+/// but every step is counted. All methods compile to no-ops unless MTSPIN_SPI_STEPPING is defined (see
+/// configuration.h).
+class SpiStepGenerator {
+ public:
+
+  /// @brief Construct an SPI Step Generator object.
+  SpiStepGenerator();
+
+  /// @brief Destroy the SPI Step Generator object.
+  ~SpiStepGenerator();
+
+  /// @brief Start shifting out step pulses.
+  /// @param step_rate The step rate (microsteps per second); limited to half the SPI bit rate.
+  void Start(float step_rate);
+
+  /// @brief Stop shifting out step pulses, after the pulses already loaded; returns the PUL pin to normal output (LOW).
+  /// @param pul_pin Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
+  void Stop(uint8_t pul_pin);
+
+  /// @brief Take the count of steps since the last call.
+  /// @return The no. of steps since the last call.
+  uint16_t TakeSteps();
+
+  /// @brief Check whether step pulses are being shifted out.
+  /// @return True if active.
+  bool active() const;
+
+ private:
+
+  bool active_ = false; ///< Whether step pulses are being shifted out.
+};
+
+} // namespace mtspin
+
+#endif // SPI_STEP_GENERATOR_H_
\ No newline at end of file
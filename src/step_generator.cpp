@@ -0,0 +1,153 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_generator.cpp
+/// @brief Class to generate step pulses at a set step rate, from a phase accumulator in a fixed-rate timer interrupt.
+
+#include "step_generator.h"
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+
+#if !defined(__AVR__)
+#error "MTSPIN_FIXED_RATE_STEPPING requires an AVR target (Timer2 is used as the tick timer)."
+#endif
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace {
+
+volatile uint8_t* pul_output_register = nullptr; ///< Output register of the stepper driver PUL pin.
+volatile uint8_t* pul_input_register = nullptr; ///< Input register of the stepper driver PUL pin; writing it toggles the pin.
+bool double_edge = false; ///< Whether steps toggle the PUL pin, rather than pulse it.
+uint8_t pul_bit_mask = 0; ///< Bit mask of the stepper driver PUL pin.
+uint32_t phase = 0; ///< The phase accumulator; a step is taken each time it overflows.
+volatile uint32_t phase_increment = 0; ///< Phase added each tick; the step rate as a fraction (of 2^32) of the tick rate.
+volatile bool hold = false; ///< Whether to skip the next tick.
+volatile uint16_t step_budget = 0; ///< No. of steps that may still be taken; never more than step_count can hold.
+volatile uint16_t step_count = 0; ///< No. of steps since they were last taken by TakeSteps().
+
+} // namespace
+
+/// @brief Timer2 compare match interrupt service routine; the step generator tick.
+ISR(TIMER2_COMPA_vect) {
+  if (!double_edge) *pul_output_register &= ~pul_bit_mask; // End any step pulse (one tick wide).
+  if (hold) {
+    hold = false;
+    return;
+  }
+
+  uint32_t previous_phase = phase;
+  phase += phase_increment;
+  if (phase < previous_phase && step_budget > 0) {
+    if (double_edge) *pul_input_register = pul_bit_mask;
+    else *pul_output_register |= pul_bit_mask;
+    step_budget--;
+    step_count++;
+  }
+}
+
+#endif // MTSPIN_FIXED_RATE_STEPPING
+
+namespace mtspin {
+
+StepGenerator::StepGenerator() {}
+
+StepGenerator::~StepGenerator() {}
+
+void StepGenerator::Begin(uint8_t pul_pin, uint32_t tick_rate_Hz, uint8_t max_smoothing_level,
+                          bool double_edge_stepping) {
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  phase_increment_per_step_rate_ = 4294967296.0F / tick_rate_Hz;
+  max_phase_increment_ = double_edge_stepping ? 0xFFFFFFFFUL : 0x80000000UL;
+  smoothing_step_rate_ = static_cast<float>(tick_rate_Hz) / kSmoothingTicksPerStep_;
+  base_compare_ = static_cast<uint16_t>(F_CPU / 8 / tick_rate_Hz);
+  max_smoothing_level_ = max_smoothing_level;
+  smoothing_level_ = 0;
+
+  // Run Timer2 in CTC mode with a prescaler of 8, interrupting at the tick rate.
+  uint8_t sreg = SREG;
+  cli();
+  pul_output_register = portOutputRegister(digitalPinToPort(pul_pin));
+  pul_input_register = portInputRegister(digitalPinToPort(pul_pin));
+  pul_bit_mask = digitalPinToBitMask(pul_pin);
+  double_edge = double_edge_stepping;
+  phase_increment = 0;
+  step_budget = 0;
+  step_count = 0;
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS21);
+  OCR2A = static_cast<uint8_t>(base_compare_ - 1);
+  TCNT2 = 0;
+  TIFR2 = _BV(OCF2A); // Clear any pending compare match.
+  TIMSK2 = _BV(OCIE2A);
+  SREG = sreg;
+#else
+  (void)pul_pin;
+  (void)tick_rate_Hz;
+  (void)max_smoothing_level;
+  (void)double_edge_stepping;
+#endif
+}
+
+void StepGenerator::SetStepRate(float step_rate) {
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  // Find the smoothing level; the tick rate is doubled each time the step rate halves, below the first threshold.
+  uint8_t level = 0;
+  float threshold = smoothing_step_rate_;
+  while (level < max_smoothing_level_ && step_rate < threshold) {
+    level++;
+    threshold *= 0.5F;
+  }
+
+  // The phase increment is per tick, so it is halved for each level.
+  float increment = step_rate * phase_increment_per_step_rate_ / (1 << level);
+  uint32_t new_phase_increment = (increment >= max_phase_increment_) ? max_phase_increment_
+                                                                     : static_cast<uint32_t>(increment);
+  uint8_t sreg = SREG;
+  cli();
+  phase_increment = new_phase_increment;
+  if (level != smoothing_level_) {
+    // Change the tick rate; the phase is a fraction of a step, so it carries over unchanged. Restart the tick if
+    // the counter is already past the new compare value, rather than letting it wrap around.
+    smoothing_level_ = level;
+    OCR2A = static_cast<uint8_t>((base_compare_ >> smoothing_level_) - 1);
+    if (TCNT2 >= OCR2A) TCNT2 = 0;
+  }
+  SREG = sreg;
+#else
+  (void)step_rate;
+#endif
+}
+
+void StepGenerator::Hold() {
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  hold = true;
+#endif
+}
+
+uint16_t StepGenerator::TakeSteps(uint32_t step_limit) {
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t steps = step_count;
+  step_count = 0;
+  // Steps already taken count towards the limit. The budget is capped at what the count can hold, so if the loop is
+  // blocked (e.g., by a log message or an EEPROM write), the generator stops rather than the count wrapping.
+  uint32_t budget = (step_limit > steps) ? (step_limit - steps) : 0;
+  step_budget = (budget > 0xFFFF) ? 0xFFFF : static_cast<uint16_t>(budget);
+  SREG = sreg;
+  return steps;
+#else
+  (void)step_limit;
+  return 0;
+#endif
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_generator.h
+/// @brief Class to generate step pulses at a set step rate, from a phase accumulator in a fixed-rate timer interrupt.
+
+#ifndef STEP_GENERATOR_H_
+#define STEP_GENERATOR_H_
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+namespace mtspin {
+
+/// @brief The Step Generator class.
+/// Timer2 interrupts at a fixed tick rate. Each tick, the step rate (as a fraction of the tick rate) is added to a
+/// 32-bit phase accumulator, and a step pulse is started on overflow and ended on the next tick; the cost per tick is
+/// a constant add-and-compare. At most one step is taken every other tick, or every tick with double-edge stepping
+/// (where PUL is toggled once per step). The step rate is set by the caller, at
+/// the control period. Steps are counted so the caller can track the position, and limited so a move cannot
+/// overshoot its target between control periods. At low step rates, the tick rate is doubled for each smoothing
+/// level (like the adaptive multi-axis step smoothing (AMASS) of GRBL), so step timing stays fine-grained where
+/// steps are far apart, without extra CPU cost at high step rates. All methods compile to no-ops, and no state is
+/// allocated, unless MTSPIN_FIXED_RATE_STEPPING is defined (see configuration.h).
+class StepGenerator {
+ public:
+
+  /// @brief Construct a Step Generator object.
+  StepGenerator();
+
+  /// @brief Destroy the Step Generator object.
+  ~StepGenerator();
+
+  /// @brief Start the tick interrupt (Timer2), with no steps.
+  /// @param pul_pin Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
+  /// @param tick_rate_Hz The base tick rate (Hz).
+  /// @param max_smoothing_level The max smoothing level; the tick rate is up to 2^level x the base tick rate.
+  /// @param double_edge_stepping Whether the driver steps on both PUL edges.
+  void Begin(uint8_t pul_pin, uint32_t tick_rate_Hz, uint8_t max_smoothing_level,
+             bool double_edge_stepping); ///< This must be called only once.
+
+  /// @brief Set the step rate, and the smoothing level for it.
+  /// @param step_rate The step rate (microsteps per second); limited to half the tick rate (or the tick rate).
+  void SetStepRate(float step_rate);
+
+  /// @brief Skip the next tick, e.g., so the driver registers a direction change before the next step.
+  void Hold();
+
+  /// @brief Take the count of steps since the last call, and limit the steps that may be taken from now on.
+  /// @param step_limit The max no. of steps from the last call; e.g., the remaining steps of a move.
+  /// @return The no. of steps since the last call.
+  uint16_t TakeSteps(uint32_t step_limit);
+
+ private:
+
+  /// @brief The ratio of the base tick rate to the step rate, below which the next smoothing level is used.
+  static const uint8_t kSmoothingTicksPerStep_ = 16;
+
+#if defined(MTSPIN_FIXED_RATE_STEPPING)
+  float phase_increment_per_step_rate_ = 0.0F; ///< Phase increment per unit of step rate (2^32 / base tick rate).
+  float smoothing_step_rate_ = 0.0F; ///< Step rate below which smoothing level 1 is used (halved for each level).
+  uint32_t max_phase_increment_ = 0; ///< Max phase increment; one step every other tick (or every tick).
+  uint16_t base_compare_ = 0; ///< Timer2 compare value + 1 at the base tick rate.
+  uint8_t max_smoothing_level_ = 0; ///< The max smoothing level.
+  uint8_t smoothing_level_ = 0; ///< The smoothing level; the tick rate is 2^level x the base tick rate.
+#endif
+};
+
+} // namespace mtspin
+
+#endif // STEP_GENERATOR_H_
\ No newline at end of file
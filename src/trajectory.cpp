@@ -0,0 +1,70 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file trajectory.cpp
+/// @brief Base class for trajectories made of cubic Hermite segments, sampled once per control period.
+
+#include "trajectory.h"
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+Trajectory::Trajectory() {}
+
+Trajectory::~Trajectory() {}
+
+void Trajectory::Sample(float elapsed_s, float& position, float& velocity) {
+  time_s_ += elapsed_s;
+  while (!in_segment_ || time_s_ >= duration_s_) {
+    // Move on to the next segment; the time past the end of the last one carries over.
+    if (in_segment_) time_s_ -= duration_s_;
+    else time_s_ = 0.0F;
+    in_segment_ = StartNextSegment();
+    if (!in_segment_) {
+      // Hold at the end position, at rest; the points ran out if the trajectory was still moving.
+      if (end_velocity_ != 0.0F) {
+        underruns_++;
+        end_velocity_ = 0.0F;
+      }
+
+      position = end_position_;
+      velocity = 0.0F;
+      return;
+    }
+  }
+
+  float t = time_s_;
+  position = a_ + (t * (b_ + (t * (c_ + (t * d_)))));
+  velocity = b_ + (t * ((2.0F * c_) + (3.0F * d_ * t)));
+}
+
+void Trajectory::StartSegment(float end_position, float end_velocity, uint16_t duration_ms) {
+  // Hermite coefficients from the end of the last segment to the point.
+  float duration_s = ((duration_ms > 0) ? duration_ms : 1) / 1000.0F;
+  float inverse_duration = 1.0F / duration_s;
+  float mean_velocity = (end_position - end_position_) * inverse_duration;
+  a_ = end_position_;
+  b_ = end_velocity_;
+  c_ = ((3.0F * mean_velocity) - (2.0F * end_velocity_) - end_velocity) * inverse_duration;
+  d_ = (end_velocity_ + end_velocity - (2.0F * mean_velocity)) * inverse_duration * inverse_duration;
+  duration_s_ = duration_s;
+  end_position_ = end_position;
+  end_velocity_ = end_velocity;
+}
+
+void Trajectory::Restart() {
+  a_ = 0.0F;
+  b_ = 0.0F;
+  c_ = 0.0F;
+  d_ = 0.0F;
+  time_s_ = 0.0F;
+  end_position_ = 0.0F;
+  end_velocity_ = 0.0F;
+  in_segment_ = false;
+  underruns_ = 0;
+}
+
+} // namespace mtspin
\ No newline at end of file
@@ -0,0 +1,69 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file trajectory.h
+/// @brief Base class for trajectories made of cubic Hermite segments, sampled once per control period.
+
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The Trajectory class.
+/// A trajectory is a chain of cubic Hermite segments, each from the end of the last to a point (position and
+/// velocity) after a duration. The coefficients are computed once when a segment starts, so sampling costs a fixed
+/// few multiplies. Derived classes supply the points, e.g., from a stream or a stored track. Positions are in
+/// centidegrees, relative to the start of the trajectory, and velocities in centidegrees per second.
+class Trajectory {
+ public:
+
+  /// @brief Construct a Trajectory object.
+  Trajectory();
+
+  /// @brief Destroy the Trajectory object.
+  virtual ~Trajectory();
+
+  /// @brief Advance along the trajectory, and sample it; holds at the last point, at rest, if there are no more.
+  /// @param elapsed_s The time (s) since the last sample.
+  /// @param position The sampled position (centidegrees).
+  /// @param velocity The sampled velocity (centidegrees per second).
+  void Sample(float elapsed_s, float& position, float& velocity);
+
+ protected:
+
+  /// @brief Start the next segment, by calling StartSegment().
+  /// @return True if a segment was started; false if there are no more points (for now).
+  virtual bool StartNextSegment() = 0;
+
+  /// @brief Start a segment from the end of the last one (or the start, at rest).
+  /// @param end_position The end position (centidegrees).
+  /// @param end_velocity The end velocity (centidegrees per second).
+  /// @param duration_ms The duration (ms); at least 1 ms.
+  void StartSegment(float end_position, float end_velocity, uint16_t duration_ms);
+
+  /// @brief Restart from the start of the trajectory, at rest.
+  void Restart();
+
+  uint16_t underruns_ = 0; ///< No. of times the points ran out while moving.
+
+ private:
+
+  // Current segment; position = a + bt + ct^2 + dt^3, for time t (s) from the start of the segment.
+  float a_ = 0.0F; ///< Hermite coefficient; the start position (centidegrees).
+  float b_ = 0.0F; ///< Hermite coefficient; the start velocity (centidegrees per second).
+  float c_ = 0.0F; ///< Hermite coefficient (centidegrees per second-squared).
+  float d_ = 0.0F; ///< Hermite coefficient (centidegrees per second-cubed).
+  float duration_s_ = 0.0F; ///< Duration (s) of the segment.
+  float time_s_ = 0.0F; ///< Time (s) from the start of the segment.
+  float end_position_ = 0.0F; ///< End position (centidegrees) of the segment.
+  float end_velocity_ = 0.0F; ///< End velocity (centidegrees per second) of the segment.
+  bool in_segment_ = false; ///< Whether a segment is in progress; otherwise, holding at the end position.
+};
+
+} // namespace mtspin
+
+#endif // TRAJECTORY_H_
\ No newline at end of file